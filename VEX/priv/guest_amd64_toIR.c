@@ -32022,6 +32022,10 @@ DisResult disInstr_AMD64_WRK (
    /* Holds the computed opcode-escape indication. */
    Escape esc = ESC_NONE;
 
+   /* Was there an EVEX (AVX-512) prefix?  These are not handled, but
+      it's worth saying so when they cause a decode failure. */
+   Bool haveEVEX = False;
+
    /* Set result defaults. */
    dres.whatNext    = Dis_Continue;
    dres.len         = 0;
@@ -32149,6 +32153,11 @@ DisResult disInstr_AMD64_WRK (
    }
 
    not_a_legacy_prefix:
+   /* In 64-bit mode, 0x62 (BOUND in 32-bit mode) always introduces an
+      EVEX prefix. */
+   if (getUChar(delta) == 0x62)
+      haveEVEX = True;
+
    /* We've used up all the non-VEX prefixes.  Parse and validate a
       VEX prefix if that's appropriate. */
    if (archinfo->hwcaps & VEX_HWCAPS_AMD64_AVX) {
@@ -32388,6 +32397,9 @@ DisResult disInstr_AMD64_WRK (
       vex_printf("vex amd64->IR:   PFX.66=%d PFX.F2=%d PFX.F3=%d\n",
                  have66(pfx) ? 1 : 0, haveF2(pfx) ? 1 : 0,
                  haveF3(pfx) ? 1 : 0);
+      if (haveEVEX)
+         vex_printf("vex amd64->IR:   EVEX-encoded (AVX-512) instructions "
+                    "are not supported\n");
    }
 
    /* Tell the dispatcher that this insn cannot be decoded, and so has
@@ -1158,6 +1158,8 @@ HInstrArray* doRegisterAllocation_v2 (
                      EMIT_INSTR(spill1);
                   if (spill2)
                      EMIT_INSTR(spill2);
+                  if (con->stats)
+                     con->stats->n_spills++;
                }
                rreg_state[k].eq_spill_slot = True;
             }
@@ -1334,6 +1336,8 @@ HInstrArray* doRegisterAllocation_v2 (
                   EMIT_INSTR(reload1);
                if (reload2)
                   EMIT_INSTR(reload2);
+               if (con->stats)
+                  con->stats->n_reloads++;
                /* This rreg is read or modified by the instruction.
                   If it's merely read we can claim it now equals the
                   spill slot, but not so if it is modified. */
@@ -1419,6 +1423,8 @@ HInstrArray* doRegisterAllocation_v2 (
                EMIT_INSTR(spill1);
             if (spill2)
                EMIT_INSTR(spill2);
+            if (con->stats)
+               con->stats->n_spills++;
          }
 
          /* Update the rreg_state to reflect the new assignment for this
@@ -1445,6 +1451,8 @@ HInstrArray* doRegisterAllocation_v2 (
                EMIT_INSTR(reload1);
             if (reload2)
                EMIT_INSTR(reload2);
+            if (con->stats)
+               con->stats->n_reloads++;
             /* This rreg is read or modified by the instruction.
                If it's merely read we can claim it now equals the
                spill slot, but not so if it is modified. */
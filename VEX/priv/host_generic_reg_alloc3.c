@@ -315,6 +315,9 @@ static inline UInt spill_vreg(
    if (spill2 != NULL) {
       emit_instr(spill2, instrs_out, con, "spill2");
    }
+   if (con->stats != NULL) {
+      con->stats->n_spills += 1;
+   }
 
    mark_vreg_spilled(v_idx, vreg_state, n_vregs, rreg_state, n_rregs);
    return r_idx;
@@ -1152,8 +1155,9 @@ HInstrArray* doRegisterAllocation_v3(
                if (reload2 != NULL) {
                   emit_instr(reload2, instrs_out, con, "reload2");
                }
-
-
+               if (con->stats != NULL) {
+                  con->stats->n_reloads += 1;
+               }
             }
 
             rreg_state[r_idx].disp          = Bound;
@@ -463,6 +463,14 @@ static inline Bool is_RetLoc_INVALID ( RetLoc rl ) {
 /*--- Reg alloc: TODO: move somewhere else              ---*/
 /*---------------------------------------------------------*/
 
+/* Counts of what the VEX register allocator added to the code. */
+typedef
+   struct {
+      UInt n_spills;
+      UInt n_reloads;
+   }
+   RegAllocStats;
+
 /* Control of the VEX register allocator. */
 typedef
    struct {
@@ -490,6 +498,10 @@ typedef
       HInstr* (*directReload)(HInstr*, HReg, Short);
       UInt    guest_sizeB;
 
+      /* Stats only: if not NULL, the number of spills and reloads
+         generated is added here. */
+      RegAllocStats* stats;
+
       /* For debug printing only. */
       void (*ppInstr)(const HInstr*, Bool);
       UInt (*ppReg)(HReg);
@@ -533,6 +533,9 @@ IRSB* LibVEX_FrontEnd ( /*MOD*/ VexTranslateArgs* vta,
    res->n_sc_extents   = 0;
    res->offs_profInc   = -1;
    res->n_guest_instrs = 0;
+   res->n_host_instrs   = 0;
+   res->n_spill_instrs  = 0;
+   res->n_reload_instrs = 0;
 
 #ifndef VEXMULTIARCH
    /* yet more sanity checks ... */
@@ -1081,12 +1084,13 @@ static void libvex_BackEnd ( const VexTranslateArgs *vta,
    }
 
    /* Register allocate. */
+   RegAllocStats ra_stats = { 0, 0 };
    RegAllocControl con = {
       .univ = rRegUniv, .isMove = isMove, .getRegUsage = getRegUsage,
       .mapRegs = mapRegs, .genSpill = genSpill, .genReload = genReload,
       .genMove = genMove, .directReload = directReload,
-      .guest_sizeB = guest_sizeB, .ppInstr = ppInstr, .ppReg = ppReg,
-      .mode64 = mode64};
+      .guest_sizeB = guest_sizeB, .stats = &ra_stats, .ppInstr = ppInstr,
+      .ppReg = ppReg, .mode64 = mode64};
    switch (vex_control.regalloc_version) {
    case 2:
       rcode = doRegisterAllocation_v2(vcode, &con);
@@ -1098,6 +1102,10 @@ static void libvex_BackEnd ( const VexTranslateArgs *vta,
       vassert(0);
    }
 
+   res->n_host_instrs   = rcode->arr_used;
+   res->n_spill_instrs  = ra_stats.n_spills;
+   res->n_reload_instrs = ra_stats.n_reloads;
+
    vexAllocSanityCheck();
 
    if (vex_traceflags & VEX_TRACE_RCODE) {
@@ -633,6 +633,12 @@ typedef
       /* Stats only: the number of guest insns included in the
          translation.  It may be zero (!). */
       UInt n_guest_instrs;
+      /* Stats only: the number of host insns generated, and the number
+         of spills and reloads that the register allocator put in among
+         them. */
+      UInt n_host_instrs;
+      UInt n_spill_instrs;
+      UInt n_reload_instrs;
    }
    VexTranslateResult;
 
@@ -61,6 +61,7 @@
 
 static Bool  clo_cache_sim  = True;  /* do cache simulation? */
 static Bool  clo_branch_sim = False; /* do branch simulation? */
+static Int   clo_sample_ratio = 1;   /* simulate 1 in this many stretches */
 static const HChar* clo_cachegrind_out_file = "cachegrind.out.%p";
 
 /*------------------------------------------------------------*/
@@ -104,6 +105,7 @@ CodeLoc;
 
 typedef struct {
    CodeLoc  loc; /* Source location that these counts pertain to */
+   ULong    execs; /* All insn executions; only counted when sampling */
    CacheCC  Ir;  /* Insn read counts */
    CacheCC  Dr;  /* Data read counts */
    CacheCC  Dw;  /* Data write/modify counts */
@@ -265,6 +267,7 @@ static LineCC* get_lineCC(Addr origAddr)
       lineCC->loc.file = get_perm_string(loc.file);
       lineCC->loc.fn   = get_perm_string(loc.fn);
       lineCC->loc.line = loc.line;
+      lineCC->execs    = 0;
       lineCC->Ir.a     = 0;
       lineCC->Ir.m1    = 0;
       lineCC->Ir.mL    = 0;
@@ -460,6 +463,198 @@ void log_ind_branch(InstrInfo* n, UWord actual_dst)
       += (1 & do_ind_branch_predict(n->instr_addr, actual_dst));
 }
 
+/*------------------------------------------------------------*/
+/*--- Sampling                                             ---*/
+/*------------------------------------------------------------*/
+
+/* With --sample-ratio=N (N > 1), the simulation is only done for one
+   stretch of execution in N, and the counts gathered in those
+   stretches are scaled up at the end (see scale_LineCC).  Which kind
+   of stretch we are in is decided by a countdown of superblock
+   executions, decremented inline at the start of each superblock.
+   Every call to a simulation helper is guarded by 'sampling', so
+   outside the sampled stretches the cost of a superblock is little
+   more than that of the inline instruction counting which provides
+   the totals to scale to.
+
+   Since the simulated caches and branch predictors are not updated
+   while unsampled, their state at the start of a sampled stretch
+   would be that left by the previous one, biasing the miss counts.
+   So each sampled stretch starts with a warm-up, during which
+   'warming' is also set: the simulated state is updated but nothing
+   is counted.  When sampling, the helpers called are the sampled_*
+   versions of the log_* ones, which check for this.
+
+   The lengths of the unsampled stretches are randomised a bit, so as
+   not to keep sampling the same phase of a program whose behaviour
+   repeats with a period that is a multiple of ours.  The run starts
+   at a random point in an unsampled stretch (see cg_post_clo_init),
+   so that its start is no more likely to be sampled than any other
+   part of it. */
+
+/* Lengths of the counted part of a sampled stretch and of the warm-up
+   before it, in superblock executions. */
+#define SAMPLE_PERIOD 10000
+#define WARM_PERIOD   (SAMPLE_PERIOD / 2)
+
+static UInt sampling         = 0;
+static UInt warming          = 0;
+static UInt sample_countdown = 0;
+static UInt sample_seed      = 0;
+
+static VG_REGPARM(0)
+void sample_switch(void)
+{
+   if (!sampling) {
+      sampling = 1;
+      warming  = 1;
+      sample_countdown = WARM_PERIOD;
+   } else if (warming) {
+      warming  = 0;
+      sample_countdown = SAMPLE_PERIOD;
+   } else {
+      /* Start an unsampled stretch, of between a half and one and a
+         half times its average length. */
+      UInt avg = (clo_sample_ratio - 1) * SAMPLE_PERIOD - WARM_PERIOD;
+      sampling = 0;
+      sample_countdown = avg / 2 + VG_(random)(&sample_seed) % (avg + 1);
+   }
+   if (sample_countdown == 0)
+      sample_countdown = 1;
+}
+
+/* The cache simulation needs somewhere to count its misses while
+   warming up. */
+static ULong warm_m1, warm_mL;
+
+static VG_REGPARM(1)
+void sampled_1Ir(InstrInfo* n)
+{
+   if (!warming)
+      log_1Ir(n);
+}
+
+static VG_REGPARM(2)
+void sampled_2Ir(InstrInfo* n, InstrInfo* n2)
+{
+   if (!warming)
+      log_2Ir(n, n2);
+}
+
+static VG_REGPARM(3)
+void sampled_3Ir(InstrInfo* n, InstrInfo* n2, InstrInfo* n3)
+{
+   if (!warming)
+      log_3Ir(n, n2, n3);
+}
+
+static VG_REGPARM(1)
+void sampled_1IrGen_0D(InstrInfo* n)
+{
+   if (!warming) {
+      log_1IrGen_0D_cache_access(n);
+      return;
+   }
+   cachesim_I1_doref_Gen(n->instr_addr, n->instr_len, &warm_m1, &warm_mL);
+}
+
+static VG_REGPARM(1)
+void sampled_1IrNoX_0D(InstrInfo* n)
+{
+   if (!warming) {
+      log_1IrNoX_0D_cache_access(n);
+      return;
+   }
+   cachesim_I1_doref_NoX(n->instr_addr, n->instr_len, &warm_m1, &warm_mL);
+}
+
+static VG_REGPARM(2)
+void sampled_2IrNoX_0D(InstrInfo* n, InstrInfo* n2)
+{
+   if (!warming) {
+      log_2IrNoX_0D_cache_access(n, n2);
+      return;
+   }
+   cachesim_I1_doref_NoX(n->instr_addr, n->instr_len, &warm_m1, &warm_mL);
+   cachesim_I1_doref_NoX(n2->instr_addr, n2->instr_len, &warm_m1, &warm_mL);
+}
+
+static VG_REGPARM(3)
+void sampled_3IrNoX_0D(InstrInfo* n, InstrInfo* n2, InstrInfo* n3)
+{
+   if (!warming) {
+      log_3IrNoX_0D_cache_access(n, n2, n3);
+      return;
+   }
+   cachesim_I1_doref_NoX(n->instr_addr, n->instr_len, &warm_m1, &warm_mL);
+   cachesim_I1_doref_NoX(n2->instr_addr, n2->instr_len, &warm_m1, &warm_mL);
+   cachesim_I1_doref_NoX(n3->instr_addr, n3->instr_len, &warm_m1, &warm_mL);
+}
+
+static VG_REGPARM(3)
+void sampled_1IrNoX_1Dr(InstrInfo* n, Addr data_addr, Word data_size)
+{
+   if (!warming) {
+      log_1IrNoX_1Dr_cache_access(n, data_addr, data_size);
+      return;
+   }
+   cachesim_I1_doref_NoX(n->instr_addr, n->instr_len, &warm_m1, &warm_mL);
+   cachesim_D1_doref(data_addr, data_size, &warm_m1, &warm_mL);
+}
+
+static VG_REGPARM(3)
+void sampled_1IrNoX_1Dw(InstrInfo* n, Addr data_addr, Word data_size)
+{
+   if (!warming) {
+      log_1IrNoX_1Dw_cache_access(n, data_addr, data_size);
+      return;
+   }
+   cachesim_I1_doref_NoX(n->instr_addr, n->instr_len, &warm_m1, &warm_mL);
+   cachesim_D1_doref(data_addr, data_size, &warm_m1, &warm_mL);
+}
+
+/* As for log_0Ir_1Dr_cache_access and log_0Ir_1Dw_cache_access,
+   addEvent_D_guarded assumes these two have the same prototype. */
+static VG_REGPARM(3)
+void sampled_0Ir_1Dr(InstrInfo* n, Addr data_addr, Word data_size)
+{
+   if (!warming) {
+      log_0Ir_1Dr_cache_access(n, data_addr, data_size);
+      return;
+   }
+   cachesim_D1_doref(data_addr, data_size, &warm_m1, &warm_mL);
+}
+
+static VG_REGPARM(3)
+void sampled_0Ir_1Dw(InstrInfo* n, Addr data_addr, Word data_size)
+{
+   if (!warming) {
+      log_0Ir_1Dw_cache_access(n, data_addr, data_size);
+      return;
+   }
+   cachesim_D1_doref(data_addr, data_size, &warm_m1, &warm_mL);
+}
+
+static VG_REGPARM(2)
+void sampled_cond_branch(InstrInfo* n, Word taken)
+{
+   if (!warming) {
+      log_cond_branch(n, taken);
+      return;
+   }
+   do_cond_branch_predict(n->instr_addr, taken);
+}
+
+static VG_REGPARM(2)
+void sampled_ind_branch(InstrInfo* n, UWord actual_dst)
+{
+   if (!warming) {
+      log_ind_branch(n, actual_dst);
+      return;
+   }
+   do_ind_branch_predict(n->instr_addr, actual_dst);
+}
+
 
 /*------------------------------------------------------------*/
 /*--- Instrumentation types and structures                 ---*/
@@ -587,6 +782,14 @@ typedef
 
       /* The output SB being constructed. */
       IRSB* sbOut;
+
+      /* When sampling: the Ity_I1 guard for the simulation helper
+         calls, and the line CC whose instruction count is to be
+         incremented by countN at the next flushCount.  NULL and 0
+         when not sampling. */
+      IRAtom* sampleGuard;
+      LineCC* countLine;
+      Int     countN;
    }
    CgState;
 
@@ -686,6 +889,31 @@ InstrInfo* setup_InstrInfo ( CgState* cgs, Addr instr_addr, UInt instr_len )
 }
 
 
+/* The sampled_* version of a log_* helper. */
+static void* sampled_helper ( void* helperAddr, const HChar** helperName )
+{
+#  define SAMPLED(log, sampled) \
+      if (helperAddr == (void*)&log) { \
+         *helperName = #sampled; \
+         return (void*)&sampled; \
+      }
+   SAMPLED(log_1Ir, sampled_1Ir);
+   SAMPLED(log_2Ir, sampled_2Ir);
+   SAMPLED(log_3Ir, sampled_3Ir);
+   SAMPLED(log_1IrGen_0D_cache_access, sampled_1IrGen_0D);
+   SAMPLED(log_1IrNoX_0D_cache_access, sampled_1IrNoX_0D);
+   SAMPLED(log_2IrNoX_0D_cache_access, sampled_2IrNoX_0D);
+   SAMPLED(log_3IrNoX_0D_cache_access, sampled_3IrNoX_0D);
+   SAMPLED(log_1IrNoX_1Dr_cache_access, sampled_1IrNoX_1Dr);
+   SAMPLED(log_1IrNoX_1Dw_cache_access, sampled_1IrNoX_1Dw);
+   SAMPLED(log_0Ir_1Dr_cache_access, sampled_0Ir_1Dr);
+   SAMPLED(log_0Ir_1Dw_cache_access, sampled_0Ir_1Dw);
+   SAMPLED(log_cond_branch, sampled_cond_branch);
+   SAMPLED(log_ind_branch, sampled_ind_branch);
+#  undef SAMPLED
+   tl_assert(0);
+}
+
 /* Generate code for all outstanding memory events, and mark the queue
    empty.  Code is generated into cgs->bbOut, and this activity
    'consumes' slots in cgs->sbInfo. */
@@ -863,15 +1091,107 @@ static void flushEvents ( CgState* cgs )
       tl_assert(helperName);
       tl_assert(helperAddr);
       tl_assert(argv);
+      if (cgs->sampleGuard)
+         helperAddr = sampled_helper(helperAddr, &helperName);
       di = unsafeIRDirty_0_N( regparms, 
                               helperName, VG_(fnptr_to_fnentry)( helperAddr ), 
                               argv );
+      if (cgs->sampleGuard)
+         di->guard = cgs->sampleGuard;
       addStmtToIRSB( cgs->sbOut, IRStmt_Dirty(di) );
    }
 
    cgs->events_used = 0;
 }
 
+#if defined(VG_BIGENDIAN)
+#  define END Iend_BE
+#elif defined(VG_LITTLEENDIAN)
+#  define END Iend_LE
+#else
+#  error "Unknown endianness"
+#endif
+
+/* Generate code to add the outstanding instruction count to its line
+   CC.  Like the events, this must be done before any exit. */
+static void flushCount ( CgState* cgs )
+{
+   IRTemp  t1, t2;
+   IRExpr* counter_addr;
+
+   if (cgs->countN == 0)
+      return;
+
+   // Add code to increment countLine->execs by countN, like this:
+   //   WrTmp(t1, Load64(&countLine->execs))
+   //   WrTmp(t2, Add64(RdTmp(t1), Const(countN)))
+   //   Store(&countLine->execs, t2)
+   t1 = newIRTemp(cgs->sbOut->tyenv, Ity_I64);
+   t2 = newIRTemp(cgs->sbOut->tyenv, Ity_I64);
+   counter_addr = mkIRExpr_HWord( (HWord)&cgs->countLine->execs );
+   addStmtToIRSB( cgs->sbOut,
+                  IRStmt_WrTmp(t1, IRExpr_Load(END, Ity_I64, counter_addr)) );
+   addStmtToIRSB( cgs->sbOut,
+                  IRStmt_WrTmp(t2, IRExpr_Binop(Iop_Add64, IRExpr_RdTmp(t1),
+                                      IRExpr_Const(IRConst_U64(cgs->countN)))) );
+   addStmtToIRSB( cgs->sbOut,
+                  IRStmt_Store(END, counter_addr, IRExpr_RdTmp(t2)) );
+
+   cgs->countLine = NULL;
+   cgs->countN    = 0;
+}
+
+/* Count an execution of an instruction in line CC 'lineCC'.
+   Consecutive instructions from the same line are counted together. */
+static void addCount ( CgState* cgs, LineCC* lineCC )
+{
+   if (cgs->countLine != lineCC)
+      flushCount(cgs);
+   cgs->countLine = lineCC;
+   cgs->countN++;
+}
+
+/* Generate code, at the start of a superblock, to count down to the
+   next switch between sampled and unsampled stretches, and to make
+   the switch when it is due.  Returns the guard for the simulation
+   helper calls in the superblock. */
+static IRAtom* addSampleSwitch ( CgState* cgs )
+{
+   IRTypeEnv* tyenv = cgs->sbOut->tyenv;
+   IRTemp     t1    = newIRTemp(tyenv, Ity_I32);
+   IRTemp     t2    = newIRTemp(tyenv, Ity_I32);
+   IRTemp     due   = newIRTemp(tyenv, Ity_I1);
+   IRTemp     on    = newIRTemp(tyenv, Ity_I32);
+   IRTemp     guard = newIRTemp(tyenv, Ity_I1);
+   IRExpr*    countdown_addr = mkIRExpr_HWord( (HWord)&sample_countdown );
+   IRDirty*   di;
+
+   addStmtToIRSB( cgs->sbOut,
+                  IRStmt_WrTmp(t1, IRExpr_Load(END, Ity_I32,
+                                               countdown_addr)) );
+   addStmtToIRSB( cgs->sbOut,
+                  IRStmt_WrTmp(t2, IRExpr_Binop(Iop_Sub32, IRExpr_RdTmp(t1),
+                                                IRExpr_Const(IRConst_U32(1)))) );
+   addStmtToIRSB( cgs->sbOut,
+                  IRStmt_Store(END, countdown_addr, IRExpr_RdTmp(t2)) );
+   addStmtToIRSB( cgs->sbOut,
+                  IRStmt_WrTmp(due, IRExpr_Binop(Iop_CmpEQ32, IRExpr_RdTmp(t2),
+                                                 IRExpr_Const(IRConst_U32(0)))) );
+   di = unsafeIRDirty_0_N( 0, "sample_switch",
+                           VG_(fnptr_to_fnentry)( &sample_switch ),
+                           mkIRExprVec_0() );
+   di->guard = IRExpr_RdTmp(due);
+   addStmtToIRSB( cgs->sbOut, IRStmt_Dirty(di) );
+   addStmtToIRSB( cgs->sbOut,
+                  IRStmt_WrTmp(on, IRExpr_Load(END, Ity_I32,
+                                   mkIRExpr_HWord( (HWord)&sampling ))) );
+   addStmtToIRSB( cgs->sbOut,
+                  IRStmt_WrTmp(guard, IRExpr_Binop(Iop_CmpNE32,
+                                         IRExpr_RdTmp(on),
+                                         IRExpr_Const(IRConst_U32(0)))) );
+   return IRExpr_RdTmp(guard);
+}
+
 static void addEvent_Ir ( CgState* cgs, InstrInfo* inode )
 {
    Event* evt;
@@ -982,6 +1302,8 @@ void addEvent_D_guarded ( CgState* cgs, InstrInfo* inode,
                          : "log_0Ir_1Dr_cache_access";
    helperAddr  = isWrite ? &log_0Ir_1Dw_cache_access
                          : &log_0Ir_1Dr_cache_access;
+   if (cgs->sampleGuard)
+      helperAddr = sampled_helper(helperAddr, &helperName);
    argv        = mkIRExprVec_3( i_node_expr,
                                 ea, mkIRExpr_HWord( datasize ) );
    regparms    = 3;
@@ -989,6 +1311,28 @@ void addEvent_D_guarded ( CgState* cgs, InstrInfo* inode,
                     regparms, 
                     helperName, VG_(fnptr_to_fnentry)( helperAddr ), 
                     argv );
+   if (cgs->sampleGuard) {
+      /* There's no Iop_And1, so go via 32 bits. */
+      IRTypeEnv* tyenv = cgs->sbOut->tyenv;
+      IRTemp     g1    = newIRTemp(tyenv, Ity_I32);
+      IRTemp     g2    = newIRTemp(tyenv, Ity_I32);
+      IRTemp     both  = newIRTemp(tyenv, Ity_I32);
+      IRTemp     g     = newIRTemp(tyenv, Ity_I1);
+      addStmtToIRSB( cgs->sbOut,
+                     IRStmt_WrTmp(g1, IRExpr_Unop(Iop_1Uto32, guard)) );
+      addStmtToIRSB( cgs->sbOut,
+                     IRStmt_WrTmp(g2, IRExpr_Unop(Iop_1Uto32,
+                                                  cgs->sampleGuard)) );
+      addStmtToIRSB( cgs->sbOut,
+                     IRStmt_WrTmp(both, IRExpr_Binop(Iop_And32,
+                                                     IRExpr_RdTmp(g1),
+                                                     IRExpr_RdTmp(g2))) );
+      addStmtToIRSB( cgs->sbOut,
+                     IRStmt_WrTmp(g, IRExpr_Binop(Iop_CmpNE32,
+                                                  IRExpr_RdTmp(both),
+                                                  IRExpr_Const(IRConst_U32(0)))) );
+      guard = IRExpr_RdTmp(g);
+   }
    di->guard = guard;
    addStmtToIRSB( cgs->sbOut, IRStmt_Dirty(di) );
 }
@@ -1085,6 +1429,9 @@ IRSB* cg_instrument ( VgCallbackClosure* closure,
    cgs.events_used = 0;
    cgs.sbInfo      = get_SB_info(sbIn, (Addr)closure->readdr);
    cgs.sbInfo_i    = 0;
+   cgs.sampleGuard = clo_sample_ratio > 1 ? addSampleSwitch(&cgs) : NULL;
+   cgs.countLine   = NULL;
+   cgs.countN      = 0;
 
    if (DEBUG_CG)
       VG_(printf)("\n\n---------- cg_instrument ----------\n");
@@ -1122,6 +1469,8 @@ IRSB* cg_instrument ( VgCallbackClosure* closure,
             curr_inode = setup_InstrInfo(&cgs, cia, isize);
 
             addEvent_Ir( &cgs, curr_inode );
+            if (cgs.sampleGuard)
+               addCount( &cgs, curr_inode->parent );
             break;
 
          case Ist_WrTmp: {
@@ -1295,6 +1644,7 @@ IRSB* cg_instrument ( VgCallbackClosure* closure,
             /* We may never reach the next statement, so need to flush
                all outstanding transactions now. */
             flushEvents( &cgs );
+            flushCount( &cgs );
             break;
          }
 
@@ -1335,6 +1685,7 @@ IRSB* cg_instrument ( VgCallbackClosure* closure,
 
    /* At the end of the bb.  Flush outstandings. */
    flushEvents( &cgs );
+   flushCount( &cgs );
 
    /* done.  stay sane ... */
    tl_assert(cgs.sbInfo_i == cgs.sbInfo->n_instrs);
@@ -1370,6 +1721,65 @@ static CacheCC  Dw_total;
 static BranchCC Bc_total;
 static BranchCC Bi_total;
 
+// When sampling, the totals of what was actually simulated, and the
+// number of instructions executed in lines which were never sampled.
+static CacheCC  Ir_sampled;
+static CacheCC  Dr_sampled;
+static CacheCC  Dw_sampled;
+static BranchCC Bc_sampled;
+static BranchCC Bi_sampled;
+static ULong    unsampled_execs;
+
+static ULong scale(ULong n, double factor)
+{
+   return (ULong)(n * factor + 0.5);
+}
+
+// Turn the counts collected for lineCC while sampling into estimates
+// for the whole run, by scaling them up by the ratio of the line's
+// instruction executions to its sampled ones.  A line which executed
+// only outside the sampled stretches gets its instruction count and
+// nothing else.
+static void scale_LineCC(LineCC* lineCC)
+{
+   double f;
+
+   Ir_sampled.a  += lineCC->Ir.a;
+   Ir_sampled.m1 += lineCC->Ir.m1;
+   Ir_sampled.mL += lineCC->Ir.mL;
+   Dr_sampled.a  += lineCC->Dr.a;
+   Dr_sampled.m1 += lineCC->Dr.m1;
+   Dr_sampled.mL += lineCC->Dr.mL;
+   Dw_sampled.a  += lineCC->Dw.a;
+   Dw_sampled.m1 += lineCC->Dw.m1;
+   Dw_sampled.mL += lineCC->Dw.mL;
+   Bc_sampled.b  += lineCC->Bc.b;
+   Bc_sampled.mp += lineCC->Bc.mp;
+   Bi_sampled.b  += lineCC->Bi.b;
+   Bi_sampled.mp += lineCC->Bi.mp;
+
+   if (lineCC->Ir.a == 0) {
+      unsampled_execs += lineCC->execs;
+      lineCC->Ir.a = lineCC->execs;
+      return;
+   }
+
+   f = (double)lineCC->execs / (double)lineCC->Ir.a;
+   lineCC->Ir.a  = lineCC->execs;
+   lineCC->Ir.m1 = scale(lineCC->Ir.m1, f);
+   lineCC->Ir.mL = scale(lineCC->Ir.mL, f);
+   lineCC->Dr.a  = scale(lineCC->Dr.a,  f);
+   lineCC->Dr.m1 = scale(lineCC->Dr.m1, f);
+   lineCC->Dr.mL = scale(lineCC->Dr.mL, f);
+   lineCC->Dw.a  = scale(lineCC->Dw.a,  f);
+   lineCC->Dw.m1 = scale(lineCC->Dw.m1, f);
+   lineCC->Dw.mL = scale(lineCC->Dw.mL, f);
+   lineCC->Bc.b  = scale(lineCC->Bc.b,  f);
+   lineCC->Bc.mp = scale(lineCC->Bc.mp, f);
+   lineCC->Bi.b  = scale(lineCC->Bi.b,  f);
+   lineCC->Bi.mp = scale(lineCC->Bi.mp, f);
+}
+
 static void fprint_CC_table_and_calc_totals(void)
 {
    Int     i;
@@ -1406,6 +1816,10 @@ static void fprint_CC_table_and_calc_totals(void)
                      "desc: D1 cache:         %s\n"
                      "desc: LL cache:         %s\n",
                      I1.desc_line, D1.desc_line, LL.desc_line);
+   if (clo_sample_ratio > 1)
+      VG_(fprintf)(fp, "desc: Sampling:         1 in %d; "
+                       "all counts but Ir are estimates\n",
+                       clo_sample_ratio);
 
    // "cmd:" line
    VG_(fprintf)(fp, "cmd: %s", VG_(args_the_exename));
@@ -1454,6 +1868,9 @@ static void fprint_CC_table_and_calc_totals(void)
          distinct_fns++;
       }
 
+      if (clo_sample_ratio > 1)
+         scale_LineCC(lineCC);
+
       // Print the LineCC
       if (clo_cache_sim && clo_branch_sim) {
          VG_(fprintf)(fp,  "%d %llu %llu %llu"
@@ -1548,6 +1965,25 @@ static void fprint_CC_table_and_calc_totals(void)
    VG_(fclose)(fp);
 }
 
+// The statistical error, as a percentage, of an estimate scaled up from
+// n sampled events, treating them as a Poisson process: 1.96 / sqrt(n),
+// i.e. two standard deviations.  This only covers the error due to
+// which stretches happened to be sampled; any bias left by a warm-up
+// too short for the caches isn't included.
+static double sample_bound(ULong n)
+{
+   double x, r;
+   Int    i;
+   if (n == 0)
+      return 100.0;
+   // Newton's method; there's no sqrt for tools.
+   x = (double)n;
+   r = x > 1.0 ? x / 2.0 : 1.0;
+   for (i = 0; i < 64; i++)
+      r = (r + x / r) / 2.0;
+   return 196.0 / r;
+}
+
 static UInt ULong_width(ULong n)
 {
    UInt w = 0;
@@ -1676,6 +2112,31 @@ static void cg_fini(Int exitcode)
                 l3, Bi_total.mp * 100.0 / Bi_total.b);
    }
 
+   /* If sampling, say how much was sampled, and the statistical error
+      of the estimates. */
+   if (clo_sample_ratio > 1) {
+      VG_(umsg)("\n");
+      VG_(umsg)("Sampling:      1 in %d (%.1f%% of instructions sampled)\n",
+                clo_sample_ratio,
+                Ir_sampled.a * 100.0 / (Ir_total.a ? Ir_total.a : 1));
+      if (clo_cache_sim || clo_branch_sim)
+         VG_(umsg)("Sampling error of estimates (excluding warm-up bias):\n");
+      if (clo_cache_sim) {
+         VG_(umsg)("  I1  misses:  +/- %.1f%%\n", sample_bound(Ir_sampled.m1));
+         VG_(umsg)("  LLi misses:  +/- %.1f%%\n", sample_bound(Ir_sampled.mL));
+         VG_(umsg)("  D1  misses:  +/- %.1f%%\n",
+                   sample_bound(Dr_sampled.m1 + Dw_sampled.m1));
+         VG_(umsg)("  LLd misses:  +/- %.1f%%\n",
+                   sample_bound(Dr_sampled.mL + Dw_sampled.mL));
+      }
+      if (clo_branch_sim)
+         VG_(umsg)("  Mispredicts: +/- %.1f%%\n",
+                   sample_bound(Bc_sampled.mp + Bi_sampled.mp));
+      if (unsampled_execs > 0)
+         VG_(umsg)("%llu instructions were in lines never sampled\n",
+                   unsampled_execs);
+   }
+
    // Various stats
    if (VG_(clo_stats)) {
       Int debug_lookups = full_debugs      + fn_debugs +
@@ -1748,6 +2209,7 @@ static Bool cg_process_cmd_line_option(const HChar* arg)
    else if VG_STR_CLO( arg, "--cachegrind-out-file", clo_cachegrind_out_file) {}
    else if VG_BOOL_CLO(arg, "--cache-sim",  clo_cache_sim)  {}
    else if VG_BOOL_CLO(arg, "--branch-sim", clo_branch_sim) {}
+   else if VG_BINT_CLO(arg, "--sample-ratio", clo_sample_ratio, 1, 10000) {}
    else
       return False;
 
@@ -1760,6 +2222,8 @@ static void cg_print_usage(void)
    VG_(printf)(
 "    --cache-sim=yes|no  [yes]        collect cache stats?\n"
 "    --branch-sim=yes|no [no]         collect branch prediction stats?\n"
+"    --sample-ratio=<n>  [1]          simulate only 1 in <n> stretches of\n"
+"                                     execution, and scale up the counts\n"
 "    --cachegrind-out-file=<file>     output file name [cachegrind.out.%%p]\n"
    );
 }
@@ -1832,6 +2296,10 @@ static void cg_post_clo_init(void)
    min_line_size = (I1c.line_size < D1c.line_size) ? I1c.line_size : D1c.line_size;
    min_line_size = (LLc.line_size < min_line_size) ? LLc.line_size : min_line_size;
 
+   if (clo_sample_ratio > 1)
+      sample_countdown = 1 + VG_(random)(&sample_seed)
+                             % (clo_sample_ratio * SAMPLE_PERIOD);
+
    Int largest_load_or_store_size
       = VG_(machine_get_size_of_largest_guest_register)();
    if (min_line_size < largest_load_or_store_size) {
@@ -214,6 +214,10 @@ static void usage_NORETURN ( Bool debug_help )
 "              To use a non-libc malloc library that is\n"
 "                  in the main exe:  --soname-synonyms=somalloc=NONE\n"
 "                  in libxyzzy.so:   --soname-synonyms=somalloc=libxyzzy.so\n"
+"    --uninstrumented-objects=patt1,patt2,...  run code in shared objects\n"
+"              whose soname matches one of the patterns with only the\n"
+"              instrumentation needed to keep the tool's state consistent\n"
+"              (some tools only).  NONE is the main executable.\n"
 "    --sigill-diagnostics=yes|no  warn about illegal instructions? [yes]\n"
 "    --unw-stack-scan-thresh=<number>   Enable stack-scan unwind if fewer\n"
 "                  than <number> good frames found  [0, meaning \"disabled\"]\n"
@@ -704,6 +708,8 @@ void main_process_cmd_line_options( void )
                                VG_(clo_trace_children_skip)) {}
       else if VG_STR_CLO (arg, "--trace-children-skip-by-arg",
                                VG_(clo_trace_children_skip_by_arg)) {}
+      else if VG_STR_CLO (arg, "--uninstrumented-objects",
+                               VG_(clo_uninstrumented_objects)) {}
 
       else if VG_BINT_CLO(arg, "--vex-iropt-verbosity",
                        VG_(clo_vex_control).iropt_verbosity, 0, 10) {}
@@ -952,6 +958,14 @@ void main_process_cmd_line_options( void )
       /*NOTREACHED*/
    }
 
+   /* Likewise for running some objects uninstrumented. */
+   if (VG_(clo_uninstrumented_objects) && !VG_(needs).uninstrumented_objects) {
+      VG_(fmsg_bad_option)("--uninstrumented-objects",
+         "%s does not support running code uninstrumented.\n",
+         VG_(details).name);
+      /*NOTREACHED*/
+   }
+
    vg_assert( VG_(clo_gen_suppressions) >= 0 );
    vg_assert( VG_(clo_gen_suppressions) <= 2 );
 
@@ -79,6 +79,7 @@ const HChar* VG_(clo_soname_synonyms)    = NULL;
 Bool   VG_(clo_trace_children) = False;
 const HChar* VG_(clo_trace_children_skip) = NULL;
 const HChar* VG_(clo_trace_children_skip_by_arg) = NULL;
+const HChar* VG_(clo_uninstrumented_objects) = NULL;
 Bool   VG_(clo_child_silent_after_fork) = False;
 const HChar *VG_(clo_log_fname_unexpanded) = NULL;
 const HChar *VG_(clo_xml_fname_unexpanded) = NULL;
@@ -413,6 +414,37 @@ Bool VG_(should_we_trace_this_child) ( const HChar* child_exe_name,
 }
 
 
+/*====================================================================*/
+/*=== --uninstrumented-objects= support                            ===*/
+/*====================================================================*/
+
+/* Does 'soname' match any of the patterns given with
+   --uninstrumented-objects= ?  This is asked once per translation, so
+   match each pattern in a stack buffer rather than malloc'ing a copy
+   of it as VG_(should_we_trace_this_child) does. */
+Bool VG_(is_uninstrumented_object) ( const HChar* soname )
+{
+   HChar const* last = VG_(clo_uninstrumented_objects);
+
+   if (last == NULL || soname == NULL)
+      return False;
+
+   while (*last) {
+      HChar const* first = consume_commas(last);
+      last = consume_field(first);
+      if (first == last)
+         break;
+      vg_assert(last > first);
+      HChar patt[last - first + 1];
+      VG_(memcpy)(patt, first, last - first);
+      patt[last - first] = 0;
+      if (VG_(string_match)(patt, soname))
+         return True;
+   }
+   return False;
+}
+
+
 /*--------------------------------------------------------------------*/
 /*--- end                                                          ---*/
 /*--------------------------------------------------------------------*/
@@ -130,16 +130,23 @@ static void mostly_clear_thread_record ( ThreadId tid );
 static ULong n_scheduling_events_MINOR = 0;
 static ULong n_scheduling_events_MAJOR = 0;
 
-/* Stats: number of XIndirs, and number that missed in the fast
-   cache. */
+/* Stats: number of XIndirs, number that missed in the fast cache,
+   and, on targets where the fast cache is set associative, the number
+   that hit in ways 1, 2 and 3 (the rest hit in way 0). */
 static ULong stats__n_xindirs = 0;
 static ULong stats__n_xindir_misses = 0;
+static ULong stats__n_xindir_hits1 = 0;
+static ULong stats__n_xindir_hits2 = 0;
+static ULong stats__n_xindir_hits3 = 0;
 
 /* And 32-bit temp bins for the above, so that 32-bit platforms don't
    have to do 64 bit incs on the hot path through
    VG_(cp_disp_xindir). */
 /*global*/ UInt VG_(stats__n_xindirs_32) = 0;
 /*global*/ UInt VG_(stats__n_xindir_misses_32) = 0;
+/*global*/ UInt VG_(stats__n_xindir_hits1_32) = 0;
+/*global*/ UInt VG_(stats__n_xindir_hits2_32) = 0;
+/*global*/ UInt VG_(stats__n_xindir_hits3_32) = 0;
 
 /* Sanity checking counts. */
 static UInt sanity_fast_count = 0;
@@ -154,6 +161,15 @@ void VG_(print_scheduler_stats)(void)
                 stats__n_xindirs, stats__n_xindir_misses,
                 stats__n_xindirs / (stats__n_xindir_misses 
                                     ? stats__n_xindir_misses : 1));
+   if (VG_TT_FAST_WAYS > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "scheduler: fast-cache hits: %'llu way0, %'llu way1, "
+                   "%'llu way2, %'llu way3\n",
+                   stats__n_xindirs - stats__n_xindir_misses
+                      - stats__n_xindir_hits1 - stats__n_xindir_hits2
+                      - stats__n_xindir_hits3,
+                   stats__n_xindir_hits1, stats__n_xindir_hits2,
+                   stats__n_xindir_hits3);
    VG_(message)(Vg_DebugMsg,
       "scheduler: %'llu/%'llu major/minor sched events.\n",
       n_scheduling_events_MAJOR, n_scheduling_events_MINOR);
@@ -880,6 +896,9 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    /* Futz with the XIndir stats counters. */
    vg_assert(VG_(stats__n_xindirs_32) == 0);
    vg_assert(VG_(stats__n_xindir_misses_32) == 0);
+   vg_assert(VG_(stats__n_xindir_hits1_32) == 0);
+   vg_assert(VG_(stats__n_xindir_hits2_32) == 0);
+   vg_assert(VG_(stats__n_xindir_hits3_32) == 0);
 
    /* Clear return area. */
    two_words[0] = two_words[1] = 0;
@@ -890,11 +909,11 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
       host_code_addr = alt_host_addr;
    } else {
       /* normal case -- redir translation */
-      UInt cno = (UInt)VG_TT_FAST_HASH((Addr)tst->arch.vex.VG_INSTR_PTR);
-      if (LIKELY(VG_(tt_fast)[cno].guest == (Addr)tst->arch.vex.VG_INSTR_PTR))
-         host_code_addr = VG_(tt_fast)[cno].host;
-      else {
-         Addr res = 0;
+      Addr res = 0;
+      if (LIKELY(VG_(lookupInFastCache)(&res,
+                                        (Addr)tst->arch.vex.VG_INSTR_PTR))) {
+         host_code_addr = res;
+      } else {
          /* not found in VG_(tt_fast). Searching here the transtab
             improves the performance compared to returning directly
             to the scheduler. */
@@ -981,6 +1000,12 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    VG_(stats__n_xindirs_32) = 0;
    stats__n_xindir_misses += (ULong)VG_(stats__n_xindir_misses_32);
    VG_(stats__n_xindir_misses_32) = 0;
+   stats__n_xindir_hits1 += (ULong)VG_(stats__n_xindir_hits1_32);
+   VG_(stats__n_xindir_hits1_32) = 0;
+   stats__n_xindir_hits2 += (ULong)VG_(stats__n_xindir_hits2_32);
+   VG_(stats__n_xindir_hits2_32) = 0;
+   stats__n_xindir_hits3 += (ULong)VG_(stats__n_xindir_hits3_32);
+   VG_(stats__n_xindir_hits3_32) = 0;
 
    /* Inspect the event counter. */
    vg_assert((Int)tst->arch.vex.host_EvC_COUNTER >= -1);
@@ -1460,6 +1485,9 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
       case VG_TRC_INNER_COUNTERZERO:
 	 /* Timeslice is out.  Let a new thread be scheduled. */
 	 vg_assert(dispatch_ctr == 0);
+         /* Where we stopped is a cheap sample of where the program
+            spends its time. */
+         VG_(note_hot_translation)( VG_(get_IP)(tid) );
 	 break;
 
       case VG_TRC_FAULT_SIGNAL:
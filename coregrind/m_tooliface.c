@@ -99,7 +99,8 @@ VgNeeds VG_(needs) = {
    .var_info	         = False,
    .malloc_replacement   = False,
    .xml_output           = False,
-   .final_IR_tidy_pass   = False
+   .final_IR_tidy_pass   = False,
+   .uninstrumented_objects = False
 };
 
 /* static */
@@ -371,6 +372,16 @@ void VG_(needs_final_IR_tidy_pass)(
    VG_(tdict).tool_final_IR_tidy_pass = final_tidy;
 }
 
+void VG_(needs_uninstrumented_objects)(
+   IRSB*(*instrument)(VgCallbackClosure*, IRSB*,
+                      const VexGuestLayout*, const VexGuestExtents*,
+                      const VexArchInfo*, IRType, IRType)
+)
+{
+   VG_(needs).uninstrumented_objects = True;
+   VG_(tdict).tool_instrument_uninstrumented = instrument;
+}
+
 /*--------------------------------------------------------------------*/
 /* Tracked events.  Digit 'n' on DEFn is the REGPARMness. */
 
@@ -75,6 +75,10 @@ static ULong n_PX_VexRegUpdUnwindregsAtMemAccess = 0;
 static ULong n_PX_VexRegUpdAllregsAtMemAccess    = 0;
 static ULong n_PX_VexRegUpdAllregsAtEachInsn     = 0;
 
+static ULong n_host_instrs   = 0;
+static ULong n_spill_instrs  = 0;
+static ULong n_reload_instrs = 0;
+
 void VG_(print_translation_stats) ( void )
 {
    UInt n_SP_updates = n_SP_updates_fast + n_SP_updates_generic_known
@@ -99,6 +103,10 @@ void VG_(print_translation_stats) ( void )
 
    VG_(message)(Vg_DebugMsg,
                 "translate: PX: SPonly %'llu,  UnwRegs %'llu,  AllRegs %'llu,  AllRegsAllInsns %'llu\n", n_PX_VexRegUpdSpAtMemAccess, n_PX_VexRegUpdUnwindregsAtMemAccess, n_PX_VexRegUpdAllregsAtMemAccess, n_PX_VexRegUpdAllregsAtEachInsn);
+
+   VG_(message)(Vg_DebugMsg,
+                "translate: host insns %'llu, spills %'llu, reloads %'llu\n",
+                n_host_instrs, n_spill_instrs, n_reload_instrs);
 }
 
 /*------------------------------------------------------------*/
@@ -222,6 +230,26 @@ static IRExpr* mk_ecu_Expr ( Addr guest_IP )
    return mkIRExpr_HWord( (HWord)ecu );
 }
 
+/*------------------------------------------------------------*/
+/*--- --uninstrumented-objects= support                    ---*/
+/*------------------------------------------------------------*/
+
+/* Is the superblock being translated in an object named by
+   --uninstrumented-objects= ?  Set by VG_(translate) for the benefit
+   of the callbacks it hands to LibVEX_Translate. */
+static Bool translating_uninstrumented = False;
+
+static Bool is_in_uninstrumented_object ( Addr a )
+{
+   DebugInfo* di;
+
+   if (VG_(clo_uninstrumented_objects) == NULL)
+      return False;
+   di = VG_(find_DebugInfo)(a);
+   return di != NULL
+          && VG_(is_uninstrumented_object)(VG_(DebugInfo_get_soname)(di));
+}
+
 /* When gdbserver is activated, the translation of a block must
    first be done by the tool function, then followed by a pass
    which (if needed) instruments the code for gdbserver.
@@ -236,7 +264,9 @@ IRSB* tool_instrument_then_gdbserver_if_needed ( VgCallbackClosure* closureV,
                                                  IRType             hWordTy )
 {
    return VG_(instrument_for_gdbserver_if_needed)
-      (VG_(tdict).tool_instrument (closureV,
+      ((translating_uninstrumented
+           ? VG_(tdict).tool_instrument_uninstrumented
+           : VG_(tdict).tool_instrument) (closureV,
                                    sb_in,
                                    layout,
                                    vge,
@@ -954,6 +984,11 @@ static Bool chase_into_ok ( void* closureV, Addr addr )
       goto dontchase;
 #  endif
 
+   /* Don't mix instrumented and uninstrumented code in one
+      superblock. */
+   if (is_in_uninstrumented_object(addr) != translating_uninstrumented)
+      goto dontchase;
+
    /* overly conservative, but .. don't chase into the distinguished
       address that m_transtab uses as an empty-slot marker for
       VG_(tt_fast). */
@@ -1713,6 +1748,13 @@ Bool VG_(translate) ( ThreadId tid,
            vex_archinfo.arm64_requires_fallback_LLSC;
 #  endif
 
+   /* Code in objects named by --uninstrumented-objects= gets the
+      tool's cut-down instrumentation instead.  VG_(main) has checked
+      that the tool provides it. */
+   translating_uninstrumented = is_in_uninstrumented_object(addr);
+   vg_assert(!translating_uninstrumented
+             || VG_(needs).uninstrumented_objects);
+
    /* Set up closure args. */
    closure.tid    = tid;
    closure.nraddr = nraddr;
@@ -1743,7 +1785,9 @@ Bool VG_(translate) ( ThreadId tid,
                const VexArchInfo*,IRType,IRType)
         = VG_(clo_vgdb) != Vg_VgdbNo
              ? tool_instrument_then_gdbserver_if_needed
-             : VG_(tdict).tool_instrument;
+             : translating_uninstrumented
+                  ? VG_(tdict).tool_instrument_uninstrumented
+                  : VG_(tdict).tool_instrument;
      IRSB*(*g)(void*,
                IRSB*,const VexGuestLayout*,const VexGuestExtents*,
                const VexArchInfo*,IRType,IRType) = (__typeof__(g)) f;
@@ -1797,6 +1841,10 @@ Bool VG_(translate) ( ThreadId tid,
    vg_assert(tres.n_sc_extents >= 0 && tres.n_sc_extents <= 3);
    vg_assert(tmpbuf_used <= N_TMPBUF);
    vg_assert(tmpbuf_used > 0);
+
+   n_host_instrs   += tres.n_host_instrs;
+   n_spill_instrs  += tres.n_spill_instrs;
+   n_reload_instrs += tres.n_reload_instrs;
    } /* END new scope specially for 'seg' */
 
    /* Tell aspacem of all segments that have had translations taken
@@ -424,6 +424,13 @@ typedef
          in strictly non-overlapping order, so we can binary search
          them at any time. */
       XArray* host_extents; /* XArray* of HostExtent */
+
+      /* A rough measure of how much time has been spent in this
+         sector's code lately.  It is bumped each time a scheduler
+         timeslice ends in one of its translations, and halved each
+         time any sector is recycled.  Used to decide which sector to
+         recycle next. */
+      ULong hotness;
    }
    Sector;
 
@@ -434,9 +441,9 @@ typedef
    youngest sector is recorded, and new translations are put into that
    sector.  When it fills up, we move along to the next sector and
    start to fill that up, wrapping around at the end of the array.
-   That way, once all N_TC_SECTORS have been bought into use for the
-   first time, and are full, we then re-use the oldest sector,
-   endlessly. 
+   Once all N_TC_SECTORS have been bought into use for the first time,
+   and are full, we then re-use the sector with the lowest hotness,
+   endlessly.  See choose_sector_to_recycle.
 
    When running, youngest sector should be between >= 0 and <
    N_TC_SECTORS.  The initial  value indicates the TT/TC system is
@@ -457,7 +464,8 @@ static Int    tc_sector_szQ = 0;
 static SECno sector_search_order[MAX_N_SECTORS];
 
 
-/* Fast helper for the TC.  A direct-mapped cache which holds a set of
+/* Fast helper for the TC.  A set-associative cache (direct mapped on
+   some targets, see pub_core_transtab_asm.h) which holds a set of
    recently used (guest address, host address) pairs.  This array is
    referred to directly from m_dispatch/dispatch-<platform>.S.
 
@@ -479,12 +487,20 @@ typedef
    }
    FastCacheEntry;
 */
-/*global*/ __attribute__((aligned(16)))
+/*global*/ __attribute__((aligned(64)))
            FastCacheEntry VG_(tt_fast)[VG_TT_FAST_SIZE];
 
 /* Make sure we're not used before initialisation. */
 static Bool init_done = False;
 
+/* The guest entry addresses of recently dumped translations, so that
+   we can count how many of them get translated again.  It is direct
+   mapped, so the count is only a lower bound.  Allocated when a
+   sector is first recycled. */
+#define N_DUMPED_ENTRIES_BITS 14
+#define N_DUMPED_ENTRIES      (1 << N_DUMPED_ENTRIES_BITS)
+static Addr* dumped_entries = NULL;
+
 
 /*------------------ STATS DECLS ------------------*/
 
@@ -508,6 +524,9 @@ static ULong n_dump_count = 0;
 static ULong n_dump_osize = 0;
 static ULong n_sectors_recycled = 0;
 
+/* Number of dumped translations which were subsequently made again. */
+static ULong n_retrans_count = 0;
+
 /* Number/osize of translations discarded due to requests to do so. */
 static ULong n_disc_count = 0;
 static ULong n_disc_osize = 0;
@@ -527,6 +546,12 @@ static void ttaux_free ( void* p )
    VG_(arena_free)(VG_AR_TTAUX, p);
 }
 
+static inline UInt dumped_entries_ix ( Addr entry )
+{
+   return (UInt)((entry ^ (entry >> N_DUMPED_ENTRIES_BITS))
+                 & (N_DUMPED_ENTRIES - 1));
+}
+
 
 /*-------------------------------------------------------------*/
 /*--- Chaining support                                      ---*/
@@ -1457,14 +1482,27 @@ static inline HTTno HASH_TT ( Addr key )
 
 static void setFastCacheEntry ( Addr key, ULong* tcptr )
 {
-   UInt cno = (UInt)VG_TT_FAST_HASH(key);
-   VG_(tt_fast)[cno].guest = key;
-   VG_(tt_fast)[cno].host  = (Addr)tcptr;
-   n_fast_updates++;
+   UInt w;
+   FastCacheEntry* set
+      = &VG_(tt_fast)[VG_TT_FAST_HASH(key) << VG_TT_FAST_WAYS_BITS];
    /* This shouldn't fail.  It should be assured by m_translate
       which should reject any attempt to make translation of code
       starting at TRANSTAB_BOGUS_GUEST_ADDR. */
-   vg_assert(VG_(tt_fast)[cno].guest != TRANSTAB_BOGUS_GUEST_ADDR);
+   vg_assert(key != TRANSTAB_BOGUS_GUEST_ADDR);
+   /* The new entry goes in way 0.  Shift the entries in front of it
+      along by one to make room, dropping the one in the last way --
+      unless key is already in the set (eg, via handle_chain_me), in
+      which case only shift up to its old position, so as to not end
+      up with two copies. */
+   for (w = 0; w < VG_TT_FAST_WAYS-1; w++) {
+      if (set[w].guest == key)
+         break;
+   }
+   for (; w > 0; w--)
+      set[w] = set[w-1];
+   set[0].guest = key;
+   set[0].host  = (Addr)tcptr;
+   n_fast_updates++;
 }
 
 /* Invalidate the fast cache VG_(tt_fast). */
@@ -1599,9 +1637,16 @@ static void initialiseSector ( SECno sno )
 
       /* Sector has been used before.  Dump the old contents. */
       if (VG_(clo_stats) || VG_(debugLog_getLevel)() >= 1)
-         VG_(dmsg)("transtab: " "recycle  sector %d\n", sno);
+         VG_(dmsg)("transtab: " "recycle  sector %d (hotness %llu)\n",
+                   sno, sec->hotness);
       n_sectors_recycled++;
 
+      if (dumped_entries == NULL) {
+         dumped_entries = ttaux_malloc("transtab.initialiseSector(dumped)",
+                                       N_DUMPED_ENTRIES * sizeof(Addr));
+         VG_(memset)(dumped_entries, 0, N_DUMPED_ENTRIES * sizeof(Addr));
+      }
+
       vg_assert(sec->ttC != NULL);
       vg_assert(sec->ttH != NULL);
       vg_assert(sec->tc_next != NULL);
@@ -1622,6 +1667,8 @@ static void initialiseSector ( SECno sno )
             vg_assert(sec->ttC[ei].n_tte2ec >= 1);
             vg_assert(sec->ttC[ei].n_tte2ec <= 3);
             n_dump_osize += TTEntryH__osize(&sec->ttH[ei]);
+            dumped_entries[dumped_entries_ix(sec->ttC[ei].entry)]
+               = sec->ttC[ei].entry;
             /* Tell the tool too. */
             if (VG_(needs).superblock_discards) {
                VexGuestExtents vge_tmp;
@@ -1678,6 +1725,7 @@ static void initialiseSector ( SECno sno )
 
    sec->tc_next = sec->tc;
    sec->tt_n_inuse = 0;
+   sec->hotness = 0;
 
    invalidateFastCache();
 
@@ -1686,6 +1734,37 @@ static void initialiseSector ( SECno sno )
    }
 }
 
+/* Choose the sector to move on to when the youngest sector, |full|,
+   has filled up.  Sectors which have never been used are taken in
+   order, as before.  Once they are all in use, we recycle the sector
+   with the lowest hotness, so that sectors holding code which is still
+   being run stay resident, and the ageing of all sectors' hotness
+   means that no sector can stay resident indefinitely on the strength
+   of old usage.  Ties go to the sector which comes first after |full|
+   in round-robin order; hence, in the absence of any usage
+   information, this behaves as plain round-robin replacement. */
+static SECno choose_sector_to_recycle ( SECno full )
+{
+   SECno sno, best = INV_SNO;
+   Int   i;
+
+   for (i = 1; i < n_sectors; i++) {
+      sno = (full + i) % n_sectors;
+      if (sectors[sno].tc == NULL) {
+         best = sno;
+         break;
+      }
+      if (best == INV_SNO || sectors[sno].hotness < sectors[best].hotness)
+         best = sno;
+   }
+   vg_assert(isValidSector(best) && best != full);
+
+   for (sno = 0; sno < n_sectors; sno++)
+      sectors[sno].hotness >>= 1;
+
+   return best;
+}
+
 /* Add a translation of vge to TT/TC.  The translation is temporarily
    in code[0 .. code_len-1].
 
@@ -1724,6 +1803,14 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
    if (is_self_checking)
       n_in_sc_count++;
 
+   if (dumped_entries != NULL) {
+      UInt ix = dumped_entries_ix(entry);
+      if (dumped_entries[ix] == entry) {
+         n_retrans_count++;
+         dumped_entries[ix] = 0;
+      }
+   }
+
    y = youngest_sector;
    vg_assert(isValidSector(y));
 
@@ -1741,10 +1828,10 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
 
    if (tcAvailQ < reqdQ 
        || sectors[y].tt_n_inuse >= N_TTES_PER_SECTOR) {
-      /* No.  So move on to the next sector.  Either it's never been
+      /* No.  So move on to another sector.  Either it's never been
          used before, in which case it will get its tt/tc allocated
          now, or it has been used before, in which case it is set to be
-         empty, hence throwing out the oldest sector. */
+         empty, hence throwing out the least used sector. */
       vg_assert(tc_sector_szQ > 0);
       Int tt_loading_pct = (100 * sectors[y].tt_n_inuse) 
                            / N_HTTES_PER_SECTOR;
@@ -1757,9 +1844,7 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
                    y, tt_loading_pct, tc_loading_pct,
                    8 * (tc_sector_szQ - tcAvailQ)/sectors[y].tt_n_inuse);
       }
-      youngest_sector++;
-      if (youngest_sector >= n_sectors)
-         youngest_sector = 0;
+      youngest_sector = choose_sector_to_recycle(y);
       y = youngest_sector;
       initialiseSector(y);
    }
@@ -1932,6 +2017,46 @@ Bool VG_(search_transtab) ( /*OUT*/Addr*  res_hcode,
    return False;
 }
 
+/* Find the sector holding the translation of guest_addr, or INV_SNO.
+   Unlike VG_(search_transtab), this has no side effects: it neither
+   counts towards the lookup stats nor reorders sector_search_order,
+   so that sampling hotness does not perturb either. */
+static SECno find_sector_of ( Addr guest_addr )
+{
+   SECno i, sno;
+   HTTno j, k, kstart;
+   TTEno tti;
+
+   kstart = HASH_TT(guest_addr);
+   for (i = 0; i < n_sectors; i++) {
+      sno = sector_search_order[i];
+      if (sno == INV_SNO)
+         break;
+      k = kstart;
+      for (j = 0; j < N_HTTES_PER_SECTOR; j++) {
+         tti = sectors[sno].htt[k];
+         if (tti < N_TTES_PER_SECTOR
+             && sectors[sno].ttC[tti].entry == guest_addr)
+            return sno;
+         if (tti == HTT_EMPTY)
+            break;
+         k++;
+         if (k == N_HTTES_PER_SECTOR)
+            k = 0;
+      }
+   }
+   return INV_SNO;
+}
+
+void VG_(note_hot_translation) ( Addr guest_addr )
+{
+   SECno sno;
+   vg_assert(init_done);
+   sno = find_sector_of( guest_addr );
+   if (sno != INV_SNO)
+      sectors[sno].hotness++;
+}
+
 
 /*-------------------------------------------------------------*/
 /*--- Delete translations.                                  ---*/
@@ -2438,6 +2563,9 @@ void VG_(init_tt_tc) ( void )
    /* check fast cache entries are packed back-to-back with no spaces */
    vg_assert(sizeof( VG_(tt_fast) ) 
              == VG_TT_FAST_SIZE * sizeof(FastCacheEntry));
+   /* check the dispatchers' idea of the size of a set is right */
+   vg_assert((1 << VG_TT_FAST_SET_SHIFT)
+             == VG_TT_FAST_WAYS * sizeof(FastCacheEntry));
    /* check fast cache is aligned as we requested.  Not fatal if it
       isn't, but we might as well make sure. */
    vg_assert(VG_IS_16_ALIGNED( ((Addr) & VG_(tt_fast)[0]) ));
@@ -2586,6 +2714,9 @@ void VG_(print_tt_tc_stats) ( void )
                 " transtab: dumped     %'llu (%'llu -> ?" "?) "
                 "(sectors recycled %'llu)\n",
                 n_dump_count, n_dump_osize, n_sectors_recycled );
+   VG_(message)(Vg_DebugMsg,
+                " transtab: retrans    %'llu (dumped, then made again)\n",
+                n_retrans_count );
    VG_(message)(Vg_DebugMsg,
                 " transtab: discarded  %'llu (%'llu -> ?" "?)\n",
                 n_disc_count, n_disc_osize );
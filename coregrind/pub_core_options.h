@@ -111,6 +111,10 @@ extern const HChar* VG_(clo_trace_children_skip);
    tested against the arguments for child processes, rather than the
    executable name. */
 extern const HChar* VG_(clo_trace_children_skip_by_arg);
+/* String containing comma-separated soname patterns for shared objects
+   whose code should be run without the tool's normal instrumentation.
+   See VG_(needs_uninstrumented_objects). */
+extern const HChar* VG_(clo_uninstrumented_objects);
 /* After a fork, the child's output can become confusingly
    intermingled with the parent's output.  This is especially
    problematic when VG_(clo_xml) is True.  Setting
@@ -379,6 +383,9 @@ extern Bool VG_(clo_dsymutil);
 extern Bool VG_(should_we_trace_this_child) ( const HChar* child_exe_name,
                                               const HChar** child_argv );
 
+/* Does 'soname' match one of the --uninstrumented-objects= patterns? */
+extern Bool VG_(is_uninstrumented_object) ( const HChar* soname );
+
 /* Whether illegal instructions should be reported/diagnosed.
    Can be explicitly set through --sigill-diagnostics otherwise
    depends on verbosity (False if -q). */
@@ -95,6 +95,7 @@ typedef
       Bool malloc_replacement;
       Bool xml_output;
       Bool final_IR_tidy_pass;
+      Bool uninstrumented_objects;
    } 
    VgNeeds;
 
@@ -174,6 +175,14 @@ typedef struct {
    // VG_(needs).final_IR_tidy_pass
    IRSB* (*tool_final_IR_tidy_pass)  (IRSB*);
 
+   // VG_(needs).uninstrumented_objects
+   IRSB* (*tool_instrument_uninstrumented)(VgCallbackClosure*,
+                                           IRSB*,
+                                           const VexGuestLayout*,
+                                           const VexGuestExtents*,
+                                           const VexArchInfo*,
+                                           IRType, IRType);
+
    // VG_(needs).xml_output
    // (none)
 
@@ -42,7 +42,9 @@
 #include "libvex.h"                   // VexGuestExtents
 
 /* The fast-cache for tt-lookup.  Unused entries are denoted by .guest
-   == 1, which is assumed to be a bogus address for all guest code. */
+   == 1, which is assumed to be a bogus address for all guest code.
+   See pub_core_transtab_asm.h for how entries are grouped into
+   sets. */
 typedef
    struct { 
       Addr guest;
@@ -50,11 +52,28 @@ typedef
    }
    FastCacheEntry;
 
-extern __attribute__((aligned(16)))
+extern __attribute__((aligned(64)))
        FastCacheEntry VG_(tt_fast) [VG_TT_FAST_SIZE];
 
 #define TRANSTAB_BOGUS_GUEST_ADDR ((Addr)1)
 
+/* Look up guest in the fast cache, and if found, write the host code
+   address to *host and return True.  This is a C version of what the
+   dispatchers do, minus the move-towards-way-0 step. */
+static inline Bool VG_(lookupInFastCache)( /*OUT*/Addr* host, Addr guest )
+{
+   const FastCacheEntry* set
+      = &VG_(tt_fast)[VG_TT_FAST_HASH(guest) << VG_TT_FAST_WAYS_BITS];
+   UInt w;
+   for (w = 0; w < VG_TT_FAST_WAYS; w++) {
+      if (LIKELY(set[w].guest == guest)) {
+         *host = set[w].host;
+         return True;
+      }
+   }
+   return False;
+}
+
 
 /* Initialises the TC, using VG_(clo_num_transtab_sectors)
    and VG_(clo_avg_transtab_entry_size).
@@ -110,6 +129,11 @@ extern Bool VG_(search_transtab) ( /*OUT*/Addr*  res_hcode,
                                    Addr          guest_addr, 
                                    Bool          upd_cache );
 
+// Note that guest_addr is where a thread was found to be running when
+// its timeslice ended.  This biases sector recycling in favour of
+// keeping such code.
+extern void VG_(note_hot_translation) ( Addr guest_addr );
+
 extern void VG_(discard_translations) ( Addr  start, ULong range,
                                         const HChar* who );
 
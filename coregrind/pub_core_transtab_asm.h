@@ -31,16 +31,31 @@
 #ifndef __PUB_CORE_TRANSTAB_ASM_H
 #define __PUB_CORE_TRANSTAB_ASM_H
 
-/* Constants for the fast translation lookup cache.  It is a direct
-   mapped cache, with 2^VG_TT_FAST_BITS entries.
+/* Constants for the fast translation lookup cache.  It has
+   2^VG_TT_FAST_BITS sets of VG_TT_FAST_WAYS entries each.  The entries
+   of a set are stored back to back in VG_(tt_fast), so way W of set S
+   is VG_(tt_fast)[(S << VG_TT_FAST_WAYS_BITS) + W], and a whole set
+   occupies 1 << VG_TT_FAST_SET_SHIFT bytes.
 
-   On x86/amd64, the cache index is computed as
-   'address[VG_TT_FAST_BITS-1 : 0]'.
+   On x86 and amd64 the cache is 4-way set associative.  Way 0 holds
+   the most recently inserted entry; a hit in way W > 0 makes the
+   dispatcher swap that entry with the one in way W-1, so hot entries
+   drift towards way 0 and the least used one drops out of way 3 when
+   a new entry is inserted.  The set number is computed as
+
+      (address ^ (address >>u VG_TT_FAST_BITS))[VG_TT_FAST_BITS-1 : 0]
+
+   so that code at the same offset in differently-placed objects does
+   not all land in the same set.
+
+   On all other targets the cache is still direct mapped (1 way), and
+   the set (== entry) number is computed as follows.
 
    On ppc32/ppc64/mips32/mips64/arm64, the bottom two bits of
-   instruction addresses are zero, which means that function causes
-   only 1/4 of the entries to ever be used.  So instead the function
-   is '(address >>u 2)[VG_TT_FAST_BITS-1 : 0]' on those targets.
+   instruction addresses are zero, which means that using the plain
+   address causes only 1/4 of the entries to ever be used.  So instead
+   the function is '(address >>u 2)[VG_TT_FAST_BITS-1 : 0]' on those
+   targets.
 
    On ARM we shift by 1, since Thumb insns can be of size 2, hence to
    minimise collisions and maximise cache utilisation we need to take
@@ -49,15 +64,36 @@
    On s390x the rightmost bit of an instruction address is zero.
    For best table utilization shift the address to the right by 1 bit. */
 
-#define VG_TT_FAST_BITS 15
-#define VG_TT_FAST_SIZE (1 << VG_TT_FAST_BITS)
-#define VG_TT_FAST_MASK ((VG_TT_FAST_SIZE) - 1)
+#if defined(VGA_x86) || defined(VGA_amd64)
+#  define VG_TT_FAST_BITS      13
+#  define VG_TT_FAST_WAYS_BITS 2
+#else
+#  define VG_TT_FAST_BITS      15
+#  define VG_TT_FAST_WAYS_BITS 0
+#endif
+
+#define VG_TT_FAST_SETS (1 << VG_TT_FAST_BITS)
+#define VG_TT_FAST_WAYS (1 << VG_TT_FAST_WAYS_BITS)
+#define VG_TT_FAST_MASK ((VG_TT_FAST_SETS) - 1)
+/* Total number of entries in VG_(tt_fast). */
+#define VG_TT_FAST_SIZE (VG_TT_FAST_SETS * VG_TT_FAST_WAYS)
+
+/* log2 of the size in bytes of one set.  A FastCacheEntry is two
+   host words. */
+#if defined(VGA_x86) || defined(VGA_arm) || defined(VGA_ppc32) \
+      || defined(VGA_mips32)
+#  define VG_TT_FAST_SET_SHIFT (3 + VG_TT_FAST_WAYS_BITS)
+#else
+#  define VG_TT_FAST_SET_SHIFT (4 + VG_TT_FAST_WAYS_BITS)
+#endif
 
 /* This macro isn't usable in asm land; nevertheless this seems
-   like a good place to put it. */
+   like a good place to put it.  It gives the set number. */
 
 #if defined(VGA_x86) || defined(VGA_amd64)
-#  define VG_TT_FAST_HASH(_addr)  ((((UWord)(_addr))     ) & VG_TT_FAST_MASK)
+#  define VG_TT_FAST_HASH(_addr) \
+      ((((UWord)(_addr)) ^ (((UWord)(_addr)) >> VG_TT_FAST_BITS)) \
+       & VG_TT_FAST_MASK)
 
 #elif defined(VGA_s390x) || defined(VGA_arm)
 #  define VG_TT_FAST_HASH(_addr)  ((((UWord)(_addr)) >> 1) & VG_TT_FAST_MASK)
@@ -780,6 +780,10 @@ static void DRD_(fini)(Int exitcode)
                    "confl set: %llu full updates and %llu partial updates;\n",
                    DRD_(thread_get_compute_conflict_set_count)(),
                    pu);
+      VG_(message)(Vg_UserMsg,
+                   "           %llu incremental updates after context"
+                   " switches,\n",
+                   DRD_(thread_get_refresh_conflict_set_count)());
       VG_(message)(Vg_UserMsg,
                    "           %llu partial updates during segment creation,\n",
                    pu_seg_cr);
@@ -79,6 +79,7 @@ static void sg_init(Segment* const sg,
    sg->thr_prev = NULL;
    sg->tid = created;
    sg->refcnt = 1;
+   sg->epoch = 0;
 
    if (vg_created != VG_INVALID_THREADID && VG_(get_SP)(vg_created) != 0)
       sg->stacktrace = VG_(record_ExeContext)(vg_created, 0);
@@ -53,6 +53,11 @@ typedef struct segment
    ExeContext*        stacktrace;
    /** Vector clock associated with the segment. */
    VectorClock        vc;
+   /**
+    * Value of the context switch counter when memory accesses may last have
+    * been recorded in this segment. See also thread_refresh_conflict_set().
+    */
+   ULong              epoch;
    /**
     * Bitmap representing the memory accesses by the instructions associated
     * with the segment.
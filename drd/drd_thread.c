@@ -50,6 +50,8 @@ static void thread_discard_segment(const DrdThreadId tid, Segment* const sg);
 static void thread_compute_conflict_set(struct bitmap** conflict_set,
                                         const DrdThreadId tid);
 static Bool thread_conflict_set_up_to_date(const DrdThreadId tid);
+static void thread_refresh_conflict_set(const DrdThreadId tid);
+static void thread_invalidate_conflict_sets(void);
 
 
 /* Local variables. */
@@ -58,6 +60,7 @@ static ULong    s_context_switch_count;
 static ULong    s_discard_ordered_segments_count;
 static ULong    s_compute_conflict_set_count;
 static ULong    s_update_conflict_set_count;
+static ULong    s_refresh_conflict_set_count;
 static ULong    s_update_conflict_set_new_sg_count;
 static ULong    s_update_conflict_set_sync_count;
 static ULong    s_update_conflict_set_join_count;
@@ -535,6 +538,13 @@ void DRD_(thread_delete)(const DrdThreadId tid, const Bool detached)
       tl_assert(!DRD_(g_threadinfo)[tid].detached_posix_thread);
    DRD_(g_threadinfo)[tid].sg_first = NULL;
    DRD_(g_threadinfo)[tid].sg_last = NULL;
+   if (DRD_(g_threadinfo)[tid].conflict_set
+       && tid != DRD_(g_drd_running_tid)) {
+      DRD_(bm_delete)(DRD_(g_threadinfo)[tid].conflict_set);
+      DRD_(g_threadinfo)[tid].conflict_set = NULL;
+   }
+   /* The conflict sets of other threads may contain the segments of tid. */
+   thread_invalidate_conflict_sets();
 
    tl_assert(!DRD_(IsValidDrdThreadId)(tid));
 }
@@ -783,10 +793,13 @@ void DRD_(thread_set_running_tid)(const ThreadId vg_tid,
                       DRD_(g_drd_running_tid), drd_tid,
                       DRD_(sg_get_segments_alive_count)());
       }
+      if (DRD_(g_drd_running_tid) != DRD_INVALID_THREADID)
+         DRD_(g_threadinfo)[DRD_(g_drd_running_tid)].conflict_set_epoch
+            = s_context_switch_count;
       s_vg_running_tid = vg_tid;
       DRD_(g_drd_running_tid) = drd_tid;
-      thread_compute_conflict_set(&DRD_(g_conflict_set), drd_tid);
       s_context_switch_count++;
+      thread_refresh_conflict_set(drd_tid);
    }
 
    tl_assert(s_vg_running_tid != VG_INVALID_THREADID);
@@ -840,6 +853,7 @@ void thread_append_segment(const DrdThreadId tid, Segment* const sg)
    DRD_(g_threadinfo)[tid].sg_last = sg;
    if (DRD_(g_threadinfo)[tid].sg_first == NULL)
       DRD_(g_threadinfo)[tid].sg_first = sg;
+   sg->epoch = s_context_switch_count;
 
 #ifdef ENABLE_DRD_CONSISTENCY_CHECKS
    tl_assert(DRD_(sane_ThreadInfo)(&DRD_(g_threadinfo)[tid]));
@@ -1110,6 +1124,7 @@ static void thread_merge_segments(void)
             {
                /* Merge sg and sg_next into sg. */
                DRD_(sg_merge)(sg, sg_next);
+               sg->epoch = sg_next->epoch;
                thread_discard_segment(i, sg_next);
             }
          }
@@ -1188,6 +1203,7 @@ void DRD_(thread_combine_vc_join)(DrdThreadId joiner, DrdThreadId joinee)
    } else {
       DRD_(vc_combine)(DRD_(thread_get_vc)(joiner),
                        DRD_(thread_get_vc)(joinee));
+      DRD_(g_threadinfo)[joiner].conflict_set_valid = False;
    }
 
    thread_discard_ordered_segments();
@@ -1275,10 +1291,16 @@ void DRD_(thread_stop_using_mem)(const Addr a1, const Addr a2)
 {
    Segment* p;
 
+   unsigned i;
+
    for (p = DRD_(g_sg_list); p; p = p->g_next)
       DRD_(bm_clear)(DRD_(sg_bm)(p), a1, a2);
 
-   DRD_(bm_clear)(DRD_(g_conflict_set), a1, a2);
+   /* Includes DRD_(g_conflict_set). */
+   for (i = 0; i < DRD_N_THREADS; i++) {
+      if (DRD_(g_threadinfo)[i].conflict_set)
+         DRD_(bm_clear)(DRD_(g_threadinfo)[i].conflict_set, a1, a2);
+   }
 }
 
 /** Specify whether memory loads should be recorded. */
@@ -1544,6 +1566,97 @@ static void thread_compute_conflict_set(struct bitmap** conflict_set,
    }
 }
 
+/**
+ * Make DRD_(g_conflict_set) the conflict set of thread tid, which is about to
+ * run. Memory accesses are only recorded in the segments of the running
+ * thread, and each such segment has been stamped with the value of the
+ * context switch counter at that time. Hence, unless the vector clock of
+ * thread tid changed while it was not running, the conflict set of thread tid
+ * is brought up to date by merging the concurrent segments with a stamp more
+ * recent than the last time thread tid ran. Segments that have meanwhile
+ * been discarded were ordered before thread tid and hence are not part of
+ * its conflict set, and merging segments does not change their ordering
+ * against thread tid.
+ */
+static void thread_refresh_conflict_set(const DrdThreadId tid)
+{
+   ThreadInfo* const ti = &DRD_(g_threadinfo)[tid];
+   Segment* p;
+   unsigned j;
+
+   tl_assert(0 <= (int)tid && tid < DRD_N_THREADS
+             && tid != DRD_INVALID_THREADID);
+   tl_assert(tid == DRD_(g_drd_running_tid));
+
+   p = ti->sg_last;
+   p->epoch = s_context_switch_count;
+
+   if (!ti->conflict_set_valid) {
+      thread_compute_conflict_set(&ti->conflict_set, tid);
+      ti->conflict_set_valid = True;
+      DRD_(g_conflict_set) = ti->conflict_set;
+      return;
+   }
+
+   s_refresh_conflict_set_count++;
+   s_conflict_set_bitmap_creation_count
+      -= DRD_(bm_get_bitmap_creation_count)();
+   s_conflict_set_bitmap2_creation_count
+      -= DRD_(bm_get_bitmap2_creation_count)();
+
+   for (j = 0; j < DRD_N_THREADS; j++) {
+      Segment* q;
+
+      if (j == tid || !DRD_(IsValidDrdThreadId)(j))
+         continue;
+
+      for (q = DRD_(g_threadinfo)[j].sg_last;
+           q && q->epoch > ti->conflict_set_epoch;
+           q = q->thr_prev) {
+         if (!DRD_(vc_lte)(&q->vc, &p->vc)
+             && !DRD_(vc_lte)(&p->vc, &q->vc)) {
+            if (UNLIKELY(s_trace_conflict_set)) {
+               HChar* str;
+
+               str = DRD_(vc_aprint)(&q->vc);
+               VG_(message)(Vg_DebugMsg,
+                            "conflict set: [%u] refreshing segment %s\n",
+                            j, str);
+               VG_(free)(str);
+            }
+            DRD_(bm_merge2)(ti->conflict_set, DRD_(sg_bm)(q));
+         }
+      }
+   }
+
+   s_conflict_set_bitmap_creation_count
+      += DRD_(bm_get_bitmap_creation_count)();
+   s_conflict_set_bitmap2_creation_count
+      += DRD_(bm_get_bitmap2_creation_count)();
+
+   DRD_(g_conflict_set) = ti->conflict_set;
+
+   if (s_trace_conflict_set_bm) {
+      VG_(message)(Vg_DebugMsg, "[%u] refreshed conflict set:\n", tid);
+      DRD_(bm_print)(DRD_(g_conflict_set));
+      VG_(message)(Vg_DebugMsg, "[%u] end of refreshed conflict set.\n", tid);
+   }
+
+   tl_assert(thread_conflict_set_up_to_date(tid));
+}
+
+/**
+ * Make sure that the conflict set of every thread gets recomputed from
+ * scratch the next time it is scheduled.
+ */
+static void thread_invalidate_conflict_sets(void)
+{
+   unsigned i;
+
+   for (i = 0; i < DRD_N_THREADS; i++)
+      DRD_(g_threadinfo)[i].conflict_set_valid = False;
+}
+
 /**
  * Update the conflict set after the vector clock of thread tid has been
  * updated from old_vc to its current value, either because a new segment has
@@ -1683,6 +1796,15 @@ ULong DRD_(thread_get_update_conflict_set_count)(void)
    return s_update_conflict_set_count;
 }
 
+/**
+ * Return how many times the conflict set has been brought up to date
+ * incrementally after a context switch.
+ */
+ULong DRD_(thread_get_refresh_conflict_set_count)(void)
+{
+   return s_refresh_conflict_set_count;
+}
+
 /**
  * Return how many times the conflict set has been updated partially
  * because a new segment has been created.
@@ -98,6 +98,15 @@ typedef struct
    Int       synchr_nesting;
    /** Delayed thread deletion sequence number. */
    unsigned  deletion_seq;
+   /**
+    * Conflict set of this thread, kept while other threads run such that it
+    * can be brought up to date incrementally when this thread runs again.
+    */
+   struct bitmap* conflict_set;
+   /** Context switch counter value when conflict_set was last up to date. */
+   ULong     conflict_set_epoch;
+   /** Whether conflict_set may be updated incrementally. */
+   Bool      conflict_set_valid;
    /**
     * ID of the creator thread. It can be safely accessed only until the
     * thread is fully created. Then the creator thread lives its own life again.
@@ -209,6 +218,7 @@ ULong DRD_(thread_get_report_races_count)(void);
 ULong DRD_(thread_get_discard_ordered_segments_count)(void);
 ULong DRD_(thread_get_compute_conflict_set_count)(void);
 ULong DRD_(thread_get_update_conflict_set_count)(void);
+ULong DRD_(thread_get_refresh_conflict_set_count)(void);
 ULong DRD_(thread_get_update_conflict_set_new_sg_count)(void);
 ULong DRD_(thread_get_update_conflict_set_sync_count)(void);
 ULong DRD_(thread_get_update_conflict_set_join_count)(void);
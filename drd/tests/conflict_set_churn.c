@@ -0,0 +1,84 @@
+/*
+ * Stress test for the incremental conflict set updates: many threads that
+ * yield often, and that create, exit and are joined while other threads keep
+ * running. Meant to be run with --verify-conflict-set=yes, which checks the
+ * conflict set of a thread each time it is brought up to date.
+ */
+
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+
+#define N_WAVES     3
+#define N_THREADS   6
+#define N_ITER     40
+
+
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_counter;
+static int s_private[N_WAVES * N_THREADS];
+
+
+static void* child_func(void* arg)
+{
+  int* p = arg;
+  int i;
+
+  for (i = 0; i < N_ITER / 4; i++)
+  {
+    (*p)++;
+    sched_yield();
+  }
+  return NULL;
+}
+
+static void* thread_func(void* arg)
+{
+  const int idx = (int)(long)arg;
+  int child_data = 0;
+  pthread_t child;
+  int i;
+
+  for (i = 0; i < N_ITER; i++)
+  {
+    s_private[idx]++;
+    pthread_mutex_lock(&s_mutex);
+    s_counter++;
+    pthread_mutex_unlock(&s_mutex);
+    if (i == N_ITER / 2)
+    {
+      pthread_create(&child, NULL, child_func, &child_data);
+      pthread_join(child, NULL);
+    }
+    if (i % 4 == 0)
+      sched_yield();
+  }
+  assert(child_data == N_ITER / 4);
+  return NULL;
+}
+
+int main(int argc, char** argv)
+{
+  pthread_t tid[N_WAVES][N_THREADS];
+  int w, i;
+
+  /* Each wave of threads is joined while the next one is running. */
+  for (w = 0; w < N_WAVES; w++)
+  {
+    for (i = 0; i < N_THREADS; i++)
+      pthread_create(&tid[w][i], NULL, thread_func,
+                     (void*)(long)(w * N_THREADS + i));
+    if (w > 0)
+      for (i = 0; i < N_THREADS; i++)
+        pthread_join(tid[w - 1][i], NULL);
+  }
+  for (i = 0; i < N_THREADS; i++)
+    pthread_join(tid[N_WAVES - 1][i], NULL);
+
+  fprintf(stderr, "Counter: %d\n", s_counter);
+
+  return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Test that a data race is still reported when the conflicting access of
+ * one thread was made in a segment that was created while the other thread
+ * was not running, i.e. after its conflict set was last brought up to date.
+ */
+
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include "../../drd/drd.h"
+
+
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_racy;
+/* Used to order the two threads without any happens-before relation. */
+static volatile int s_started;
+static volatile int s_written;
+
+
+static void* thread_func(void* arg)
+{
+  s_started = 1;
+  while (!s_written)
+    sched_yield();
+  s_racy = 2;
+  return NULL;
+}
+
+int main(int argc, char** argv)
+{
+  pthread_t tid;
+
+  DRD_IGNORE_VAR(s_started);
+  DRD_IGNORE_VAR(s_written);
+
+  pthread_create(&tid, NULL, thread_func, NULL);
+  while (!s_started)
+    sched_yield();
+
+  /*
+   * The thread created above is now waiting. Start a new segment, which
+   * the thread's conflict set does not cover yet, and access s_racy in it.
+   */
+  pthread_mutex_lock(&s_mutex);
+  pthread_mutex_unlock(&s_mutex);
+  s_racy = 1;
+  s_written = 1;
+
+  pthread_join(tid, NULL);
+
+  fprintf(stderr, "Done.\n");
+
+  return 0;
+}
@@ -77,6 +77,8 @@ UWord HG_(clo_history_level) = 2;
 
 UWord HG_(clo_conflict_cache_size) = 2000000;
 
+UWord HG_(clo_history_budget) = 0;
+
 UWord HG_(clo_sanity_flags) = 0;
 
 Bool  HG_(clo_free_is_write) = False;
@@ -85,6 +87,12 @@ UWord HG_(clo_vts_pruning) = 1;
 
 Bool  HG_(clo_check_stack_refs) = True;
 
+Bool  HG_(clo_race_sampling) = False;
+
+UWord HG_(clo_race_sampling_cold) = 100;
+
+UWord HG_(clo_race_sampling_rate) = 1000;
+
 /*--------------------------------------------------------------------*/
 /*--- end                                              hg_basics.c ---*/
 /*--------------------------------------------------------------------*/
@@ -99,6 +99,13 @@ extern UWord HG_(clo_history_level);
    amd 10 million.  Default is 1 million. */
 extern UWord HG_(clo_conflict_cache_size);
 
+/* When doing "full" history collection, the maximum memory, in
+   megabytes, used for the conflicting-access cache and the stack
+   traces it refers to.  If this is reached before
+   --conflict-cache-size, the least useful entries are discarded.
+   0 means no limit.  Default is 0. */
+extern UWord HG_(clo_history_budget);
+
 /* Sanity check level.  This is an or-ing of
    SCE_{THREADS,LOCKS,BIGRANGE,ACCESS,LAOG}. */
 extern UWord HG_(clo_sanity_flags);
@@ -126,6 +133,19 @@ extern UWord HG_(clo_vts_pruning);
    the stack, which speeds things up a bit.  Default: True. */
 extern Bool HG_(clo_check_stack_refs); 
 
+/* When True, memory references in code that has run many times are
+   only race-checked on a sample of its executions.  Synchronisation
+   events are still tracked exactly.  Default: False. */
+extern Bool HG_(clo_race_sampling);
+
+/* With --race-sampling=yes, the number of executions of each
+   superblock which are always checked.  Default: 100. */
+extern UWord HG_(clo_race_sampling_cold);
+
+/* With --race-sampling=yes, the lowest rate at which a superblock is
+   checked, as 1 in this many executions.  Default: 1000. */
+extern UWord HG_(clo_race_sampling_rate);
+
 #endif /* ! __HG_BASICS_H */
 
 /*--------------------------------------------------------------------*/
@@ -3451,10 +3451,7 @@ void evh__HG_RTLD_BIND_CLEAR(ThreadId tid, Int flags)
 /*--- Lock acquisition order monitoring                      ---*/
 /*--------------------------------------------------------------*/
 
-/* FIXME: here are some optimisations still to do in
-          laog__pre_thread_acquires_lock.
-
-   The graph is structured so that if L1 --*--> L2 then L1 must be
+/* The graph is structured so that if L1 --*--> L2 then L1 must be
    acquired before L2.
 
    The common case is that some thread T holds (eg) L1 L2 and L3 and
@@ -3467,26 +3464,61 @@ void evh__HG_RTLD_BIND_CLEAR(ThreadId tid, Int flags)
    (2) adds edges {L1,L2,L3} --> Ln to laog, which are already present
        (because they already got added the first time T acquired Ln).
 
-   Hence cache these two events:
-
-   (1) Cache result of the query from last time.  Invalidate the cache
-       any time any edges are added to or deleted from laog.
-
-   (2) Cache these add-edge requests and ignore them if said edges
-       have already been added to laog.  Invalidate the cache any time
-       any edges are deleted from laog.
-*/
+   For (1), as long as laog is acyclic we maintain a topological order
+   of its nodes ('ord' below: for every edge L1 --> L2, L1.ord <
+   L2.ord), updated incrementally as edges are added, using the
+   algorithm of Pearce and Kelly ("A Dynamic Topological Sort
+   Algorithm for Directed Acyclic Graphs", JEA 2006).  Any path
+   Ln --*--> Lk then implies Ln.ord < Lk.ord, so if Ln.ord exceeds
+   the ord of every lock held, the answer is No without searching.
+   Otherwise the search only needs to visit nodes whose ord is not
+   above that of the held locks.  Removing edges or nodes never
+   invalidates the order.
+
+   Once a lock order error has been found, the offending edges are
+   still added and laog contains a cycle, so no topological order
+   exists.  We then fall back to an unbounded search, and try to
+   recompute an order from scratch (Kahn's algorithm) every so often
+   as locks get deleted, since that is the only way cycles go away.
+
+   For (2), laog__add_edge returns at once if the edge is already
+   present. */
 
 typedef
    struct {
       WordSetID inns; /* in univ_laog */
       WordSetID outs; /* in univ_laog */
+      UWord     ord;  /* position in the topological order, if any */
+      UInt      mark; /* == laog_mark_gen if visited by current search */
    }
    LAOGLinks;
 
 /* lock order acquisition graph */
 static WordFM* laog = NULL; /* WordFM Lock* LAOGLinks* */
 
+/* True if the 'ord' fields of laog currently form a topological
+   order, which implies laog is acyclic. */
+static Bool  laog_acyclic = True;
+static UWord laog_next_ord = 0;   /* ord given to the next new node */
+static UInt  laog_mark_gen = 0;   /* see LAOGLinks.mark */
+/* While laog is cyclic: lock deletions, and nodes visited by
+   searches, since the last attempt to recompute an order. */
+static UWord laog_dels_since_sort   = 0;
+static UWord laog_visits_since_sort = 0;
+
+/* Scratch space for the searches, kept to avoid allocating them
+   on each lock acquisition. */
+static XArray* laog_stack  = NULL; /* of Lock* */
+static XArray* laog_deltaF = NULL; /* of LAOGLinks* */
+static XArray* laog_deltaB = NULL; /* of LAOGLinks* */
+
+static UWord stats__laog_queries = 0;   /* laog__do_dfs_from_to calls */
+static UWord stats__laog_qfast   = 0;   /* .. answered without search */
+static UWord stats__laog_visits  = 0;   /* nodes visited by searches */
+static UWord stats__laog_edges_present = 0; /* add_edge of existing edge */
+static UWord stats__laog_reorders = 0;  /* topological order updates */
+static UWord stats__laog_resorts  = 0;  /* .. and full recomputations */
+
 /* EXPOSITION ONLY: for each edge in 'laog', record the two places
    where that edge was created, so that we can show the user later if
    we need to. */
@@ -3513,6 +3545,14 @@ static Word cmp_LAOGLinkExposition ( UWord llx1W, UWord llx2W ) {
 static WordFM* laog_exposition = NULL; /* WordFM LAOGLinkExposition* NULL */
 /* end EXPOSITION ONLY */
 
+static Int cmp_LAOGLinks_by_ord ( const void* v1, const void* v2 ) {
+   const LAOGLinks* l1 = *(const LAOGLinks* const*)v1;
+   const LAOGLinks* l2 = *(const LAOGLinks* const*)v2;
+   if (l1->ord < l2->ord) return -1;
+   if (l1->ord > l2->ord) return  1;
+   return 0;
+}
+
 
 __attribute__((noinline))
 static void laog__init ( void )
@@ -3526,6 +3566,15 @@ static void laog__init ( void )
 
    laog_exposition = VG_(newFM)( HG_(zalloc), "hg.laog__init.2", HG_(free), 
                                  cmp_LAOGLinkExposition );
+
+   laog_stack  = VG_(newXA)( HG_(zalloc), "hg.laog__init.3", HG_(free),
+                             sizeof(Lock*) );
+   laog_deltaF = VG_(newXA)( HG_(zalloc), "hg.laog__init.4", HG_(free),
+                             sizeof(LAOGLinks*) );
+   laog_deltaB = VG_(newXA)( HG_(zalloc), "hg.laog__init.5", HG_(free),
+                             sizeof(LAOGLinks*) );
+   VG_(setCmpFnXA)( laog_deltaF, cmp_LAOGLinks_by_ord );
+   VG_(setCmpFnXA)( laog_deltaB, cmp_LAOGLinks_by_ord );
 }
 
 static void laog__show ( const HChar* who ) {
@@ -3629,59 +3678,223 @@ static void univ_laog_do_GC ( void ) {
 }
 
 
+static LAOGLinks* laog__links ( Lock* lk ) {
+   LAOGLinks* links = NULL;
+   if (VG_(lookupFM)( laog, NULL, (UWord*)&links, (UWord)lk )) {
+      tl_assert(links);
+      return links;
+   }
+   return NULL;
+}
+
+/* Start a new search: afterwards, no node is marked. */
+static void laog__new_mark_gen ( void ) {
+   laog_mark_gen++;
+   if (laog_mark_gen == 0) {
+      /* Wrapped around.  Clear the marks so that stale ones cannot
+         be taken for current ones. */
+      Lock*      lk;
+      LAOGLinks* links;
+      VG_(initIterFM)( laog );
+      while (VG_(nextIterFM)( laog, (UWord*)&lk, (UWord*)&links ))
+         links->mark = 0;
+      VG_(doneIterFM)( laog );
+      laog_mark_gen = 1;
+   }
+}
+
+/* Collect into 'delta' the nodes reachable from 'start' by following
+   out edges (if 'fwd') or in edges (otherwise), restricted to nodes
+   whose ord lies in [lb, ub].  Returns False if that reaches the node
+   at the other end of the range, in which case there is a cycle. */
+static Bool laog__pk_collect ( LAOGLinks* start, Bool fwd,
+                               UWord lb, UWord ub, XArray* delta )
+{
+   Word   i;
+   UWord  j, n;
+   UWord* words;
+   laog__new_mark_gen();
+   VG_(dropTailXA)( delta, VG_(sizeXA)( delta ) );
+   start->mark = laog_mark_gen;
+   (void) VG_(addToXA)( delta, &start );
+   for (i = 0; i < VG_(sizeXA)( delta ); i++) {
+      LAOGLinks* here = *(LAOGLinks**)VG_(indexXA)( delta, i );
+      HG_(getPayloadWS)( &words, &n, univ_laog,
+                         fwd ? here->outs : here->inns );
+      for (j = 0; j < n; j++) {
+         LAOGLinks* next = laog__links( (Lock*)words[j] );
+         tl_assert(next);
+         stats__laog_visits++;
+         if (next->ord == (fwd ? ub : lb))
+            return False;
+         if (next->ord < lb || next->ord > ub
+             || next->mark == laog_mark_gen)
+            continue;
+         next->mark = laog_mark_gen;
+         (void) VG_(addToXA)( delta, &next );
+      }
+   }
+   return True;
+}
+
+/* The edge src --> dst has just been added to laog.  Restore the
+   topological order if it is now violated, or note that laog is no
+   longer acyclic.  Only the nodes whose ord lies between those of dst
+   and src can need to move: those reachable from dst (deltaF) must
+   end up after those reaching src (deltaB), reusing the same set of
+   ord values. */
+static void laog__update_order ( Lock* src, Lock* dst )
+{
+   LAOGLinks* lsrc = laog__links( src );
+   LAOGLinks* ldst = laog__links( dst );
+   UWord      lb, ub, nF, nB, i, iF, iB;
+   UWord*     ords;
+
+   tl_assert(lsrc && ldst);
+   if (lsrc == ldst) {
+      laog_acyclic = False;
+      return;
+   }
+   lb = ldst->ord;
+   ub = lsrc->ord;
+   if (ub < lb)
+      return;
+
+   stats__laog_reorders++;
+   if (!laog__pk_collect( ldst, True/*fwd*/, lb, ub, laog_deltaF )) {
+      laog_acyclic = False;
+      return;
+   }
+   if (!laog__pk_collect( lsrc, False/*fwd*/, lb, ub, laog_deltaB ))
+      tl_assert(0); /* the forward search would have found the cycle */
+
+   VG_(sortXA)( laog_deltaF );
+   VG_(sortXA)( laog_deltaB );
+   nF = VG_(sizeXA)( laog_deltaF );
+   nB = VG_(sizeXA)( laog_deltaB );
+
+   /* Merge the two sets of ords into ascending order ... */
+   ords = HG_(zalloc)( "hg.lauo.1", (nF + nB) * sizeof(UWord) );
+   iF = iB = 0;
+   for (i = 0; i < nF + nB; i++) {
+      LAOGLinks* f = iF < nF
+                     ? *(LAOGLinks**)VG_(indexXA)( laog_deltaF, iF ) : NULL;
+      LAOGLinks* b = iB < nB
+                     ? *(LAOGLinks**)VG_(indexXA)( laog_deltaB, iB ) : NULL;
+      if (f && (!b || f->ord < b->ord)) {
+         ords[i] = f->ord; iF++;
+      } else {
+         ords[i] = b->ord; iB++;
+      }
+   }
+   /* ... and hand them out to deltaB then deltaF, keeping the
+      relative order within each. */
+   for (i = 0; i < nB; i++)
+      (*(LAOGLinks**)VG_(indexXA)( laog_deltaB, i ))->ord = ords[i];
+   for (i = 0; i < nF; i++)
+      (*(LAOGLinks**)VG_(indexXA)( laog_deltaF, i ))->ord = ords[nB + i];
+   HG_(free)( ords );
+}
+
+/* Try to compute a topological order of laog from scratch, using
+   Kahn's algorithm.  Succeeds iff laog has become acyclic. */
+static void laog__recompute_order ( void )
+{
+   Lock*      lk;
+   LAOGLinks* links;
+   UWord      i, j, n;
+   UWord*     words;
+   XArray*    queue = laog_deltaF;
+
+   stats__laog_resorts++;
+   laog_dels_since_sort   = 0;
+   laog_visits_since_sort = 0;
+
+   /* While sorting, the ord of a node not yet in the queue holds the
+      number of its predecessors not yet in the queue. */
+   VG_(dropTailXA)( queue, VG_(sizeXA)( queue ) );
+   VG_(initIterFM)( laog );
+   while (VG_(nextIterFM)( laog, (UWord*)&lk, (UWord*)&links )) {
+      links->ord = HG_(cardinalityWS)( univ_laog, links->inns );
+      if (links->ord == 0)
+         (void) VG_(addToXA)( queue, &links );
+   }
+   VG_(doneIterFM)( laog );
+
+   for (i = 0; i < VG_(sizeXA)( queue ); i++) {
+      links = *(LAOGLinks**)VG_(indexXA)( queue, i );
+      HG_(getPayloadWS)( &words, &n, univ_laog, links->outs );
+      for (j = 0; j < n; j++) {
+         LAOGLinks* next = laog__links( (Lock*)words[j] );
+         tl_assert(next && next->ord > 0);
+         next->ord--;
+         if (next->ord == 0)
+            (void) VG_(addToXA)( queue, &next );
+      }
+   }
+
+   n = VG_(sizeXA)( queue );
+   if (n < VG_(sizeFM)( laog ))
+      return; /* still cyclic */
+   for (i = 0; i < n; i++)
+      (*(LAOGLinks**)VG_(indexXA)( queue, i ))->ord = i;
+   laog_next_ord = n;
+   laog_acyclic  = True;
+}
+
 __attribute__((noinline))
 static void laog__add_edge ( Lock* src, Lock* dst ) {
    UWord      keyW;
    LAOGLinks* links;
-   Bool       presentF, presentR;
    if (0) VG_(printf)("laog__add_edge %p %p\n", src, dst);
 
-   /* Take the opportunity to sanity check the graph.  Record in
-      presentF if there is already a src->dst mapping in this node's
-      forwards links, and presentR if there is already a src->dst
-      mapping in this node's backwards links.  They should agree!
-      Also, we need to know whether the edge was already present so as
-      to decide whether or not to update the link details mapping.  We
-      can compute presentF and presentR essentially for free, so may
-      as well do this always. */
-   presentF = presentR = False;
-
    /* Update the out edges for src */
    keyW  = 0;
    links = NULL;
    if (VG_(lookupFM)( laog, &keyW, (UWord*)&links, (UWord)src )) {
-      WordSetID outs_new;
       tl_assert(links);
       tl_assert(keyW == (UWord)src);
-      outs_new = HG_(addToWS)( univ_laog, links->outs, (UWord)dst );
-      presentF = outs_new == links->outs;
-      links->outs = outs_new;
+      /* Nothing to do if the edge is already there: the common case
+         of a thread retaking the same locks in the same order.  Take
+         the opportunity to sanity check the graph: dst's backwards
+         links must agree. */
+      if (HG_(elemWS)( univ_laog, links->outs, (UWord)dst )) {
+         LAOGLinks* dst_links = laog__links( dst );
+         tl_assert(dst_links);
+         tl_assert(HG_(elemWS)( univ_laog, dst_links->inns, (UWord)src ));
+         stats__laog_edges_present++;
+         return;
+      }
+      links->outs = HG_(addToWS)( univ_laog, links->outs, (UWord)dst );
    } else {
       links = HG_(zalloc)("hg.lae.1", sizeof(LAOGLinks));
       links->inns = HG_(emptyWS)( univ_laog );
       links->outs = HG_(singletonWS)( univ_laog, (UWord)dst );
+      links->ord  = laog_next_ord++;
       VG_(addToFM)( laog, (UWord)src, (UWord)links );
    }
    /* Update the in edges for dst */
    keyW  = 0;
    links = NULL;
    if (VG_(lookupFM)( laog, &keyW, (UWord*)&links, (UWord)dst )) {
-      WordSetID inns_new;
       tl_assert(links);
       tl_assert(keyW == (UWord)dst);
-      inns_new = HG_(addToWS)( univ_laog, links->inns, (UWord)src );
-      presentR = inns_new == links->inns;
-      links->inns = inns_new;
+      /* The edge is new, so dst can't have a backwards link to src
+         yet either. */
+      tl_assert(!HG_(elemWS)( univ_laog, links->inns, (UWord)src ));
+      links->inns = HG_(addToWS)( univ_laog, links->inns, (UWord)src );
    } else {
       links = HG_(zalloc)("hg.lae.2", sizeof(LAOGLinks));
       links->inns = HG_(singletonWS)( univ_laog, (UWord)src );
       links->outs = HG_(emptyWS)( univ_laog );
+      links->ord  = laog_next_ord++;
       VG_(addToFM)( laog, (UWord)dst, (UWord)links );
    }
 
-   tl_assert( (presentF && presentR) || (!presentF && !presentR) );
+   if (laog_acyclic)
+      laog__update_order( src, dst );
 
-   if (!presentF && src->acquired_at && dst->acquired_at) {
+   if (src->acquired_at && dst->acquired_at) {
       LAOGLinkExposition expo;
       /* If this edge is entering the graph, and we have acquired_at
          information for both src and dst, record those acquisition
@@ -3813,6 +4026,9 @@ static void laog__sanity_check ( const HChar* who ) {
                              laog__preds( (Lock*)ws_words[i] ), 
                              (UWord)me ))
             goto bad;
+         if (laog_acyclic
+             && links->ord >= laog__links( (Lock*)ws_words[i] )->ord)
+            goto bad;
       }
       me = NULL;
       links = NULL;
@@ -3834,52 +4050,83 @@ __attribute__((noinline))
 static
 Lock* laog__do_dfs_from_to ( Lock* src, WordSetID dsts /* univ_lsets */ )
 {
-   Lock*     ret;
-   Word      ssz;
-   XArray*   stack;   /* of Lock* */
-   WordFM*   visited; /* Lock* -> void, iow, Set(Lock*) */
-   Lock*     here;
-   WordSetID succs;
-   UWord     succs_size, i;
-   UWord*    succs_words;
+   Word       ssz;
+   Lock*      here;
+   LAOGLinks* links;
+   UWord      dsts_size, succs_size, i, ub;
+   UWord*     dsts_words;
+   UWord*     succs_words;
+   Bool       any;
    //laog__sanity_check();
 
+   stats__laog_queries++;
+
    /* If the destination set is empty, we can never get there from
       'src' :-), so don't bother to try */
    if (HG_(isEmptyWS)( univ_lsets, dsts ))
       return NULL;
+   if (HG_(elemWS)( univ_lsets, dsts, (UWord)src ))
+      return src;
+
+   /* If locks were deleted since laog became cyclic, it may be acyclic
+      again.  Recomputing the order costs about as much as visiting
+      the whole graph, so only try once the unbounded searches have
+      done that much work. */
+   if (!laog_acyclic && laog_dels_since_sort > 0
+       && laog_visits_since_sort >= VG_(sizeFM)( laog ))
+      laog__recompute_order();
+
+   /* Only nodes with an ord up to 'ub' can lead to a lock in 'dsts'.
+      Locks not in laog have no edges and so cannot be reached. */
+   ub  = laog_acyclic ? 0 : ~(UWord)0;
+   any = False;
+   HG_(getPayloadWS)( &dsts_words, &dsts_size, univ_lsets, dsts );
+   for (i = 0; i < dsts_size; i++) {
+      links = laog__links( (Lock*)dsts_words[i] );
+      if (links) {
+         any = True;
+         if (links->ord > ub)
+            ub = links->ord;
+      }
+   }
+   links = laog__links( src );
+   if (!any || !links || links->ord > ub) {
+      stats__laog_qfast++;
+      return NULL;
+   }
 
-   ret     = NULL;
-   stack   = VG_(newXA)( HG_(zalloc), "hg.lddft.1", HG_(free), sizeof(Lock*) );
-   visited = VG_(newFM)( HG_(zalloc), "hg.lddft.2", HG_(free), NULL/*unboxedcmp*/ );
-
-   (void) VG_(addToXA)( stack, &src );
+   /* Otherwise, search depth first, pruning the nodes beyond 'ub'.
+      These cannot reach any of 'dsts', so the lock returned is the
+      same one an unpruned search would have found. */
+   laog__new_mark_gen();
+   VG_(dropTailXA)( laog_stack, VG_(sizeXA)( laog_stack ) );
+   (void) VG_(addToXA)( laog_stack, &src );
 
    while (True) {
 
-      ssz = VG_(sizeXA)( stack );
+      ssz = VG_(sizeXA)( laog_stack );
 
-      if (ssz == 0) { ret = NULL; break; }
+      if (ssz == 0) return NULL;
 
-      here = *(Lock**) VG_(indexXA)( stack, ssz-1 );
-      VG_(dropTailXA)( stack, 1 );
+      here = *(Lock**) VG_(indexXA)( laog_stack, ssz-1 );
+      VG_(dropTailXA)( laog_stack, 1 );
 
-      if (HG_(elemWS)( univ_lsets, dsts, (UWord)here )) { ret = here; break; }
+      if (HG_(elemWS)( univ_lsets, dsts, (UWord)here )) return here;
 
-      if (VG_(lookupFM)( visited, NULL, NULL, (UWord)here ))
+      links = laog__links( here );
+      tl_assert(links);
+      if (links->ord > ub || links->mark == laog_mark_gen)
          continue;
 
-      VG_(addToFM)( visited, (UWord)here, 0 );
+      links->mark = laog_mark_gen;
+      stats__laog_visits++;
+      if (!laog_acyclic)
+         laog_visits_since_sort++;
 
-      succs = laog__succs( here );
-      HG_(getPayloadWS)( &succs_words, &succs_size, univ_laog, succs );
+      HG_(getPayloadWS)( &succs_words, &succs_size, univ_laog, links->outs );
       for (i = 0; i < succs_size; i++)
-         (void) VG_(addToXA)( stack, &succs_words[i] );
+         (void) VG_(addToXA)( laog_stack, &succs_words[i] );
    }
-
-   VG_(deleteFM)( visited, NULL, NULL );
-   VG_(deleteXA)( stack );
-   return ret;
 }
 
 
@@ -4079,6 +4326,12 @@ static void laog__handle_one_lock_deletion ( Lock* lk )
       }
    }
    /* FIXME ??? What about removing lock lk data from EXPOSITION ??? */
+
+   /* Deleting locks is the only way cycles disappear from laog.  See
+      laog__do_dfs_from_to for when we then try to recompute an
+      order. */
+   if (!laog_acyclic)
+      laog_dels_since_sort++;
 }
 
 //__attribute__((noinline))
@@ -4393,6 +4646,133 @@ Bool HG_(mm_find_containing_block)( /*OUT*/ExeContext** where,
 }
 
 
+/*--------------------------------------------------------------*/
+/*--- Sampled race checking (--race-sampling=yes)            ---*/
+/*--------------------------------------------------------------*/
+
+/* With --race-sampling=yes, the memory accesses in a superblock are
+   only race-checked on some of its executions, in the style of
+   LiteRace.  The first --race-sampling-cold executions of each
+   superblock are always checked, on the theory that races hide in
+   rarely run code.  After that, the superblock is checked in bursts
+   of SAMPLE_BURST executions, and the gap between bursts doubles
+   each time until only 1 in --race-sampling-rate executions is
+   checked.  Synchronisation events are not instrumented code and so
+   are never sampled: the happens-before relation stays exact, and so
+   sampling can miss races but cannot report false ones.
+
+   The counters live in an SBSample per superblock, keyed by guest
+   address.  When a translation is discarded, the code at its address
+   may be replaced (by munmap or self-modifying code), so its SBSample
+   is reset to the cold state by hg_discard_superblock_info.  They are
+   only updated by generated code, by hg_sample_reschedule and on
+   discards, and since only one thread runs at a time no locking is
+   needed.  'count' is reset from time to time so that
+   it cannot wrap; the executions it held are folded into the 64-bit
+   totals. */
+
+/* Length of a sampled burst, in superblock executions. */
+#define SAMPLE_BURST 10
+
+typedef
+   struct {
+      UInt  count;   /* executions, since the last reset */
+      UInt  until;   /* check executions while count < until */
+      UInt  next;    /* start the next burst when count == next */
+      UInt  gap;     /* current distance between burst starts */
+      UInt  checked; /* checked executions, since the last reset */
+      ULong count_base;
+      ULong checked_base;
+   }
+   SBSample;
+
+static WordFM* map_sb_samples = NULL; /* WordFM guest-Addr SBSample* */
+
+/* Put 's' in the cold state, in which every execution is checked.
+   The executions counted so far are kept in the totals. */
+static void reset_SBSample ( SBSample* s )
+{
+   s->count_base   += s->count;
+   s->checked_base += s->checked;
+   s->count   = 0;
+   s->checked = 0;
+   s->until   = (UInt)HG_(clo_race_sampling_cold) + 1;
+   s->next    = s->until;
+   s->gap     = SAMPLE_BURST;
+}
+
+static SBSample* get_SBSample ( Addr ga )
+{
+   UWord     keyW, valW;
+   SBSample* s;
+   if (map_sb_samples == NULL)
+      map_sb_samples = VG_(newFM)( HG_(zalloc), "hg.gSBS.1",
+                                   HG_(free), NULL/*unboxed Word cmp*/ );
+   if (VG_(lookupFM)( map_sb_samples, &keyW, &valW, (UWord)ga ))
+      return (SBSample*)valW;
+   s = HG_(zalloc)( "hg.gSBS.2", sizeof(SBSample) );
+   reset_SBSample(s);
+   VG_(addToFM)( map_sb_samples, (UWord)ga, (UWord)s );
+   return s;
+}
+
+/* A translation is being discarded.  Whatever is translated at its
+   address next may be different code, which must not inherit the old
+   counters and so skip its cold phase.  The SBSample is reset rather
+   than freed, since generated code holds pointers to it, and proving
+   that the discarded translation held the last one isn't worth it. */
+static void hg_discard_superblock_info ( Addr orig_addr,
+                                         VexGuestExtents vge )
+{
+   UWord keyW, valW;
+   if (map_sb_samples == NULL)
+      return;
+   if (VG_(lookupFM)( map_sb_samples, &keyW, &valW, (UWord)vge.base[0] ))
+      reset_SBSample( (SBSample*)valW );
+}
+
+/* Called from generated code when s->count reaches s->next: start a
+   burst of checked executions and decide when the next one is. */
+static VG_REGPARM(1) void hg_sample_reschedule ( SBSample* s )
+{
+   UInt c = s->count;
+   UInt max_gap = SAMPLE_BURST * (UInt)HG_(clo_race_sampling_rate);
+   if (c >= 0x80000000U) {
+      s->count_base   += c;
+      s->checked_base += s->checked;
+      s->count   = c = 0;
+      s->checked = 0;
+   }
+   s->gap = s->gap >= max_gap / 2 ? max_gap : 2 * s->gap;
+   s->until = c + SAMPLE_BURST;
+   s->next  = c + s->gap;
+}
+
+static void pp_race_sampling_stats ( void )
+{
+   UWord     keyW, valW;
+   ULong     execs = 0, checked = 0;
+   UWord     n_hot = 0;
+   SBSample* s;
+
+   if (map_sb_samples == NULL)
+      return;
+   VG_(initIterFM)( map_sb_samples );
+   while (VG_(nextIterFM)( map_sb_samples, &keyW, &valW )) {
+      s = (SBSample*)valW;
+      execs   += s->count_base + s->count;
+      checked += s->checked_base + s->checked;
+      if (s->count_base + s->count > HG_(clo_race_sampling_cold))
+         n_hot++;
+   }
+   VG_(doneIterFM)( map_sb_samples );
+   VG_(printf)("   race sampling: %'8lu superblocks (%'lu past cold), "
+               "%'llu execs, %'llu checked (%.1f%%)\n",
+               VG_(sizeFM)( map_sb_samples ), n_hot, execs, checked,
+               execs ? checked * 100.0 / execs : 0.0);
+}
+
+
 /*--------------------------------------------------------------*/
 /*--- Instrumentation                                        ---*/
 /*--------------------------------------------------------------*/
@@ -4404,6 +4784,14 @@ Bool HG_(mm_find_containing_block)( /*OUT*/ExeContext** where,
 #define mkU64(_n)                IRExpr_Const(IRConst_U64(_n))
 #define assign(_t, _e)           IRStmt_WrTmp((_t), (_e))
 
+#if defined(VG_BIGENDIAN)
+#  define END Iend_BE
+#elif defined(VG_LITTLEENDIAN)
+#  define END Iend_LE
+#else
+#  error "Unknown endianness"
+#endif
+
 /* This takes and returns atoms, of course.  Not full IRExprs. */
 static IRExpr* mk_And1 ( IRSB* sbOut, IRExpr* arg1, IRExpr* arg2 )
 {
@@ -4424,13 +4812,63 @@ static IRExpr* mk_And1 ( IRSB* sbOut, IRExpr* arg1, IRExpr* arg2 )
    return mkexpr(res);
 }
 
+/* Generate code, at the start of a superblock, to count its
+   executions in 's' and to start a new sampled burst when one is
+   due.  Returns the guard for the race checks in the superblock. */
+static IRExpr* mk_sample_guard ( IRSB* sbOut, SBSample* s )
+{
+   IRTypeEnv* tyenv = sbOut->tyenv;
+   IRTemp     c0    = newIRTemp(tyenv, Ity_I32);
+   IRTemp     c1    = newIRTemp(tyenv, Ity_I32);
+   IRTemp     next  = newIRTemp(tyenv, Ity_I32);
+   IRTemp     due   = newIRTemp(tyenv, Ity_I1);
+   IRTemp     c2    = newIRTemp(tyenv, Ity_I32);
+   IRTemp     until = newIRTemp(tyenv, Ity_I32);
+   IRTemp     on    = newIRTemp(tyenv, Ity_I1);
+   IRTemp     on32  = newIRTemp(tyenv, Ity_I32);
+   IRTemp     k0    = newIRTemp(tyenv, Ity_I32);
+   IRTemp     k1    = newIRTemp(tyenv, Ity_I32);
+   IRExpr*    count_addr   = mkIRExpr_HWord( (HWord)&s->count );
+   IRExpr*    checked_addr = mkIRExpr_HWord( (HWord)&s->checked );
+   IRDirty*   di;
+
+   /* count++; if (count == next) hg_sample_reschedule(s) */
+   addStmtToIRSB(sbOut, assign(c0, IRExpr_Load(END, Ity_I32, count_addr)));
+   addStmtToIRSB(sbOut, assign(c1, binop(Iop_Add32, mkexpr(c0), mkU32(1))));
+   addStmtToIRSB(sbOut, IRStmt_Store(END, count_addr, mkexpr(c1)));
+   addStmtToIRSB(sbOut, assign(next, IRExpr_Load(END, Ity_I32,
+                                mkIRExpr_HWord( (HWord)&s->next ))));
+   addStmtToIRSB(sbOut, assign(due, binop(Iop_CmpEQ32, mkexpr(c1),
+                                                       mkexpr(next))));
+   di = unsafeIRDirty_0_N( 1, "hg_sample_reschedule",
+                           VG_(fnptr_to_fnentry)( &hg_sample_reschedule ),
+                           mkIRExprVec_1( mkIRExpr_HWord( (HWord)s ) ) );
+   di->guard = mkexpr(due);
+   addStmtToIRSB(sbOut, IRStmt_Dirty(di));
+
+   /* on = count <u until; checked += on.  The reschedule may have
+      reset count, so load it again. */
+   addStmtToIRSB(sbOut, assign(c2, IRExpr_Load(END, Ity_I32, count_addr)));
+   addStmtToIRSB(sbOut, assign(until, IRExpr_Load(END, Ity_I32,
+                                 mkIRExpr_HWord( (HWord)&s->until ))));
+   addStmtToIRSB(sbOut, assign(on, binop(Iop_CmpLT32U, mkexpr(c2),
+                                                      mkexpr(until))));
+   addStmtToIRSB(sbOut, assign(on32, unop(Iop_1Uto32, mkexpr(on))));
+   addStmtToIRSB(sbOut, assign(k0, IRExpr_Load(END, Ity_I32, checked_addr)));
+   addStmtToIRSB(sbOut, assign(k1, binop(Iop_Add32, mkexpr(k0),
+                                                    mkexpr(on32))));
+   addStmtToIRSB(sbOut, IRStmt_Store(END, checked_addr, mkexpr(k1)));
+   return mkexpr(on);
+}
+
 static void instrument_mem_access ( IRSB*   sbOut, 
                                     IRExpr* addr,
                                     Int     szB,
                                     Bool    isStore,
                                     Int     hWordTy_szB,
                                     Int     goff_sp,
-                                    IRExpr* guard ) /* NULL => True */
+                                    IRExpr* guard, /* NULL => True */
+                                    IRExpr* sampleGuard ) /* ditto */
 {
    IRType   tyAddr   = Ity_INVALID;
    const HChar* hName    = NULL;
@@ -4585,6 +5023,12 @@ static void instrument_mem_access ( IRSB*   sbOut,
       di->guard = mk_And1(sbOut, di->guard, guard);
    }
 
+   /* Likewise for the guard saying whether this execution of the
+      superblock is sampled. */
+   if (sampleGuard) {
+      di->guard = mk_And1(sbOut, di->guard, sampleGuard);
+   }
+
    /* Add the helper. */
    addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
 }
@@ -4622,6 +5066,7 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
    IRStmt* st;
    Bool    inLDSO = False;
    Addr    inLDSOmask4K = 1; /* mismatches on first check */
+   IRExpr* sampleGuard = NULL;
 
    const Int goff_sp = layout->offset_SP;
 
@@ -4648,6 +5093,9 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
       i++;
    }
 
+   if (HG_(clo_race_sampling))
+      sampleGuard = mk_sample_guard(bbOut, get_SBSample(vge->base[0]));
+
    // Get the first statement, and initial cia from it
    tl_assert(bbIn->stmts_used > 0);
    tl_assert(i < bbIn->stmts_used);
@@ -4719,7 +5167,7 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
                      * sizeofIRType(typeOfIRExpr(bbIn->tyenv, cas->dataLo)),
                   False/*!isStore*/,
                   sizeofIRType(hWordTy), goff_sp,
-                  NULL/*no-guard*/
+                  NULL/*no-guard*/, sampleGuard
                );
             }
             break;
@@ -4740,7 +5188,7 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
                      sizeofIRType(dataTy),
                      False/*!isStore*/,
                      sizeofIRType(hWordTy), goff_sp,
-                     NULL/*no-guard*/
+                     NULL/*no-guard*/, sampleGuard
                   );
                }
             } else {
@@ -4758,7 +5206,7 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
                   sizeofIRType(typeOfIRExpr(bbIn->tyenv, st->Ist.Store.data)),
                   True/*isStore*/,
                   sizeofIRType(hWordTy), goff_sp,
-                  NULL/*no-guard*/
+                  NULL/*no-guard*/, sampleGuard
                );
             }
             break;
@@ -4772,7 +5220,7 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
             instrument_mem_access( bbOut, addr, sizeofIRType(type),
                                    True/*isStore*/,
                                    sizeofIRType(hWordTy),
-                                   goff_sp, sg->guard );
+                                   goff_sp, sg->guard, sampleGuard );
             break;
          }
 
@@ -4786,7 +5234,7 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
             instrument_mem_access( bbOut, addr, sizeofIRType(type),
                                    False/*!isStore*/,
                                    sizeofIRType(hWordTy),
-                                   goff_sp, lg->guard );
+                                   goff_sp, lg->guard, sampleGuard );
             break;
          }
 
@@ -4800,7 +5248,7 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
                      sizeofIRType(data->Iex.Load.ty),
                      False/*!isStore*/,
                      sizeofIRType(hWordTy), goff_sp,
-                     NULL/*no-guard*/
+                     NULL/*no-guard*/, sampleGuard
                   );
                }
             }
@@ -4820,7 +5268,8 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
                   if (!inLDSO) {
                      instrument_mem_access( 
                         bbOut, d->mAddr, dataSize, False/*!isStore*/,
-                        sizeofIRType(hWordTy), goff_sp, NULL/*no-guard*/
+                        sizeofIRType(hWordTy), goff_sp, NULL/*no-guard*/,
+                        sampleGuard
                      );
                   }
                }
@@ -4828,7 +5277,8 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
                   if (!inLDSO) {
                      instrument_mem_access( 
                         bbOut, d->mAddr, dataSize, True/*isStore*/,
-                        sizeofIRType(hWordTy), goff_sp, NULL/*no-guard*/
+                        sizeofIRType(hWordTy), goff_sp, NULL/*no-guard*/,
+                        sampleGuard
                      );
                   }
                }
@@ -4857,6 +5307,7 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
 #undef mkU32
 #undef mkU64
 #undef assign
+#undef END
 
 
 /*----------------------------------------------------------------*/
@@ -5590,6 +6041,8 @@ static Bool hg_process_cmd_line_option ( const HChar* arg )
 
    else if VG_BINT_CLO(arg, "--conflict-cache-size",
                        HG_(clo_conflict_cache_size), 10*1000, 150*1000*1000) {}
+   else if VG_BINT_CLO(arg, "--history-budget",
+                       HG_(clo_history_budget), 0, 1000*1000) {}
 
    /* "stuvwx" --> stuvwx (binary) */
    else if VG_STR_CLO(arg, "--hg-sanity-flags", tmp_str) {
@@ -5626,6 +6079,12 @@ static Bool hg_process_cmd_line_option ( const HChar* arg )
                             HG_(clo_check_stack_refs)) {}
    else if VG_BOOL_CLO(arg, "--ignore-thread-creation",
                             HG_(clo_ignore_thread_creation)) {}
+   else if VG_BOOL_CLO(arg, "--race-sampling",
+                            HG_(clo_race_sampling)) {}
+   else if VG_BINT_CLO(arg, "--race-sampling-cold",
+                       HG_(clo_race_sampling_cold), 0, 1000*1000) {}
+   else if VG_BINT_CLO(arg, "--race-sampling-rate",
+                       HG_(clo_race_sampling_rate), 1, 1000*1000) {}
 
    else 
       return VG_(replacement_malloc_process_cmd_line_option)(arg);
@@ -5643,10 +6102,18 @@ static void hg_print_usage ( void )
 "       approx: full trace for one thread, approx for the other (faster)\n"
 "       none:   only show trace for one thread in a race (fastest)\n"
 "    --conflict-cache-size=N   size of 'full' history cache [2000000]\n"
+"    --history-budget=<number> most megabytes to use for 'full' history,\n"
+"                              0 for no limit [0]\n"
 "    --check-stack-refs=no|yes race-check reads and writes on the\n"
 "                              main stack and thread stacks? [yes]\n"
 "    --ignore-thread-creation=yes|no Ignore activities during thread\n"
-"                              creation [%s]\n",
+"                              creation [%s]\n"
+"    --race-sampling=no|yes    only race-check a sample of the executions\n"
+"                              of frequently run code? [no]\n"
+"    --race-sampling-cold=N    always check the first N executions of a\n"
+"                              block of code [100]\n"
+"    --race-sampling-rate=N    check at least 1 in N executions of hot\n"
+"                              code [1000]\n",
 HG_(clo_ignore_thread_creation) ? "yes" : "no"
    );
 }
@@ -5724,6 +6191,13 @@ static void hg_print_stats (void)
                   (Int)(laog ? VG_(sizeFM)( laog ) : 0));
       VG_(printf)(" LAOG exposition: %'8d map size\n",
                   (Int)(laog_exposition ? VG_(sizeFM)( laog_exposition ) : 0));
+      VG_(printf)("    LAOG queries: %'8lu (%'lu without search), "
+                  "%'lu nodes visited\n",
+                  stats__laog_queries, stats__laog_qfast, stats__laog_visits);
+      VG_(printf)("      LAOG edges: %'8lu already present, "
+                  "%'lu reorders, %'lu resorts, %s\n",
+                  stats__laog_edges_present, stats__laog_reorders,
+                  stats__laog_resorts, laog_acyclic ? "acyclic" : "cyclic");
    }
 
    VG_(printf)("           locks: %'8lu acquires, "
@@ -5732,6 +6206,8 @@ static void hg_print_stats (void)
                stats__lockN_releases
               );
    VG_(printf)("   sanity checks: %'8lu\n", stats__sanity_checks);
+   if (HG_(clo_race_sampling))
+      pp_race_sampling_stats();
 
    VG_(printf)("\n");
    libhb_shutdown(True); // This in fact only print stats.
@@ -5862,6 +6338,7 @@ static void hg_pre_clo_init ( void )
    //                                hg_expensive_sanity_check);
 
    VG_(needs_print_stats) (hg_print_stats);
+   VG_(needs_superblock_discards) (hg_discard_superblock_info);
    VG_(needs_info_location) (hg_info_location);
 
    VG_(needs_malloc_replacement)  (hg_cli__malloc,
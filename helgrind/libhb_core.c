@@ -154,11 +154,12 @@ typedef  ULong  SVal;
    at a clock rate of 5 GHz is 162.9 days.  And that's doing nothing
    but VTS ticks, which isn't realistic.
 
-   NB1: SCALARTS_N_THRBITS must be 27 or lower.  The obvious limit is
-   32 since a ThrID is a UInt.  27 comes from the fact that
+   NB1: SCALARTS_N_THRBITS must be 26 or lower.  The obvious limit is
+   32 since a ThrID is a UInt.  26 comes from the fact that
    'Thr_n_RCEC', which records information about old accesses, packs
-   in tsw not only a ThrID but also minimum 4+1 other bits (access size
-   and writeness) in a UInt, hence limiting size to 32-(4+1) == 27.
+   in tsw not only a ThrID but also minimum 4+1+1 other bits (access
+   size, writeness and OldRef list) in a UInt, hence limiting size to
+   32-(4+1+1) == 26.
 
    NB2: thrid values are issued upwards from 1024, and values less
    than that aren't valid.  This isn't per se necessary (any order
@@ -186,7 +187,7 @@ typedef  ULong  SVal;
    ThrID == 0 to denote an empty Thr_n_RCEC record.  So ThrID == 0
    must never be a valid ThrID.  Given NB2 that's OK.
 */
-#define SCALARTS_N_THRBITS 18  /* valid range: 11 to 27 inclusive,
+#define SCALARTS_N_THRBITS 18  /* valid range: 11 to 26 inclusive,
                                   See NB1 and NB2 above. */
 
 #define SCALARTS_N_TYMBITS (64 - SCALARTS_N_THRBITS)
@@ -280,6 +281,10 @@ typedef
    segments. */
 #define N_KWs_N_STACKs_PER_THREAD 62500
 
+/* Size of each thread's caches of VtsIDs known to be <= its clocks.
+   Must be a power of 2. */
+#define N_THR_LEQ_CACHE 64
+
 
 struct _Thr {
    /* Current VTSs for this thread.  They change as we go along.  viR
@@ -291,6 +296,17 @@ struct _Thr {
    VtsID viR;
    VtsID viW;
 
+   /* VtsIDs recently found to be <= viR and <= viW respectively,
+      direct-mapped on the VtsID.  A thread's clocks only ever advance,
+      so an entry stays true however viR and viW change, until the next
+      VTS GC (which may free or renumber the VtsID) empties these.  They
+      answer most of the checks on memory last accessed in an earlier
+      segment, which the global cmpLEQ cache misses each time this
+      thread's clocks change; and when the check succeeds for a write
+      clock, its join with viW is viW itself. */
+   VtsID leqR_cache[N_THR_LEQ_CACHE];
+   VtsID leqW_cache[N_THR_LEQ_CACHE];
+
    /* Is initially False, and is set to True after the thread really
       has done a low-level exit.  When True, we expect to never see
       any more memory references done by this thread. */
@@ -3365,6 +3381,7 @@ static VTS* temp_max_sized_VTS = NULL;
 
 //////////////////////////
 static ULong stats__cmpLEQ_queries = 0;
+static ULong stats__cmpLEQ_thr_hits = 0;
 static ULong stats__cmpLEQ_misses  = 0;
 static ULong stats__join2_queries  = 0;
 static ULong stats__join2_misses   = 0;
@@ -3388,8 +3405,11 @@ static
    struct { VtsID vi1; VtsID vi2; VtsID res; }
    join2_cache[N_JOIN2_CACHE];
 
+static void Thr__invalidate_leq_caches ( void ); /* fwds */
+
 static void VtsID__invalidate_caches ( void ) {
    Int i;
+   Thr__invalidate_leq_caches();
    for (i = 0; i < N_CMPLEQ_CACHE; i++) {
       cmpLEQ_cache[i].vi1 = VtsID_INVALID;
       cmpLEQ_cache[i].vi2 = VtsID_INVALID;
@@ -3487,6 +3507,44 @@ static inline VtsID VtsID__join2 ( VtsID vi1, VtsID vi2 ) {
    return LIKELY(vi1 == vi2)  ? vi1  : VtsID__join2_WRK(vi1, vi2);
 }
 
+/* Is vi <= thr's read (resp. write) clock?  As VtsID__cmpLEQ, but
+   consulting and filling the thread's own cache first.  Anything <=
+   viW is also <= viR, so the write cache serves reads too. */
+static inline Bool VtsID__cmpLEQ_thrR ( VtsID vi, Thr* thr ) {
+   UWord ix = vi & (N_THR_LEQ_CACHE - 1);
+   if (LIKELY(vi == thr->viR))
+      return True;
+   if (LIKELY(thr->leqR_cache[ix] == vi || thr->leqW_cache[ix] == vi)) {
+      stats__cmpLEQ_thr_hits++;
+      return True;
+   }
+   if (!VtsID__cmpLEQ_WRK(vi, thr->viR))
+      return False;
+   thr->leqR_cache[ix] = vi;
+   return True;
+}
+static inline Bool VtsID__cmpLEQ_thrW ( VtsID vi, Thr* thr ) {
+   UWord ix = vi & (N_THR_LEQ_CACHE - 1);
+   if (LIKELY(vi == thr->viW))
+      return True;
+   if (LIKELY(thr->leqW_cache[ix] == vi)) {
+      stats__cmpLEQ_thr_hits++;
+      return True;
+   }
+   if (!VtsID__cmpLEQ_WRK(vi, thr->viW))
+      return False;
+   thr->leqW_cache[ix] = vi;
+   return True;
+}
+
+/* join(vi, thr's write clock), which is just the write clock when vi
+   is <= it, as it usually is. */
+static inline VtsID VtsID__join2_thrW ( VtsID vi, Thr* thr ) {
+   if (LIKELY(VtsID__cmpLEQ_thrW(vi, thr)))
+      return thr->viW;
+   return VtsID__join2_WRK(vi, thr->viW);
+}
+
 /* create a singleton VTS, namely [thr:1] */
 static VtsID VtsID__mk_Singleton ( Thr* thr, ULong tym ) {
    temp_max_sized_VTS->usedTS = 0;
@@ -4018,11 +4076,32 @@ static Thr* Thr__from_ThrID ( UInt thrid ) {
    return thr;
 }
 
+static void Thr__invalidate_leq_caches_for ( Thr* thr )
+{
+   UWord i;
+   for (i = 0; i < N_THR_LEQ_CACHE; i++) {
+      thr->leqR_cache[i] = VtsID_INVALID;
+      thr->leqW_cache[i] = VtsID_INVALID;
+   }
+}
+
+static void Thr__invalidate_leq_caches ( void )
+{
+   Word i, n;
+   if (!thrid_to_thr_map)
+      return;
+   n = VG_(sizeXA)( thrid_to_thr_map );
+   for (i = 0; i < n; i++)
+      Thr__invalidate_leq_caches_for(
+         *(Thr**)VG_(indexXA)( thrid_to_thr_map, i ) );
+}
+
 static Thr* Thr__new ( void )
 {
    Thr* thr = HG_(zalloc)( "libhb.Thr__new.1", sizeof(Thr) );
    thr->viR = VtsID_INVALID;
    thr->viW = VtsID_INVALID;
+   Thr__invalidate_leq_caches_for( thr );
    thr->llexit_done = False;
    thr->joinedwith_done = False;
    thr->filter = HG_(zalloc)( "libhb.Thr__new.2", sizeof(Filter) );
@@ -4192,7 +4271,7 @@ static inline SVal Ptr2SVal (void* ptr)
       it is removed from the set and freed up.  The intent is to have
       a set of stack traces which can be referred to from (2), but to
       only represent each one once.  The set is indexed/searched by
-      ordering on the stack trace vectors.
+      ordering on the stack trace vectors, which are stored compressed.
 
    2. A Hash table of OldRefs.  These store information about each old
       ref that we need to record.  Hash table key is the address of the
@@ -4207,8 +4286,11 @@ static inline SVal Ptr2SVal (void* ptr)
       The important part of an OldRef is, however, its acc component.
       This binds a TSW triple (thread, size, R/W) to an RCEC.
 
-      We allocate a maximum of VG_(clo_conflict_cache_size) OldRef.
-      Then we do exact LRU discarding.  For each discarded OldRef we must
+      We allocate a maximum of VG_(clo_conflict_cache_size) OldRef,
+      and fewer if the OldRefs and the RCECs they refer to would use
+      more than HG_(clo_history_budget) megabytes.  Then we discard
+      OldRefs using a segmented LRU: see the comments on mru/lru below.
+      For each discarded OldRef we must
       of course decrement the reference count on the RCEC it
       refers to, in order that entries from (1) eventually get
       discarded too.
@@ -4237,51 +4319,121 @@ static UWord stats__ctxt_tab_cmps = 0;
 #define N_FRAMES 8
 
 // (UInt) `echo "Reference Counted Execution Context" | md5sum`
-#define RCEC_MAGIC 0xab88abb2UL
+#define RCEC_MAGIC 0xab88abb2U
 
 //#define N_RCEC_TAB 98317 /* prime */
 #define N_RCEC_TAB 196613 /* prime */
 
+/* The frames of an RCEC are stored compressed.  Only the non-zero
+   frames are kept, and each is stored as the difference from the
+   frame before it (the first from zero), zigzag-mapped so that small
+   negative differences are small too, then LEB128-encoded.  The
+   return addresses in a stack trace usually lie in one or two
+   objects, so most differences fit in 2 or 3 bytes, and a typical
+   8 frame RCEC takes about half the space of the uncompressed one. */
+#define RCEC_MAX_ENC_SZB (N_FRAMES * (8 * sizeof(UWord) + 6) / 7)
+
 typedef
    struct _RCEC {
-      UWord magic;  /* sanity check only */
       struct _RCEC* next;
-      UWord rc;
-      UWord rcX; /* used for crosschecking */
-      UWord frames_hash;          /* hash of all the frames */
-      UWord frames[N_FRAMES];
+      UWord  frames_hash;          /* hash of all the frames */
+      UInt   magic;  /* sanity check only */
+      UInt   rc;
+      UInt   rcX; /* used for crosschecking */
+      UShort szB;     /* allocated size of this RCEC */
+      UChar  nFrames; /* nr of non-zero frames */
+      UChar  encSzB;  /* size of frames_enc */
+      UChar  frames_enc[0];
    }
    RCEC;
 
+/* RCECs are allocated from a pool for each size they can have, in
+   multiples of the word size. */
+#define RCEC_MAX_SZB (sizeof(RCEC) + RCEC_MAX_ENC_SZB)
+#define N_RCEC_POOLS ((RCEC_MAX_SZB + sizeof(UWord) - 1) / sizeof(UWord))
+
 //////////// BEGIN RCEC pool allocator
-static PoolAlloc* rcec_pool_allocator;
-static RCEC* alloc_RCEC ( void ) {
-   return VG_(allocEltPA) ( rcec_pool_allocator );
+static PoolAlloc* rcec_pool_allocators[N_RCEC_POOLS + 1];
+
+static inline UInt RCEC_szB_for_enc ( UInt encSzB ) {
+   return VG_ROUNDUP(sizeof(RCEC) + encSzB, sizeof(UWord));
+}
+
+static RCEC* alloc_RCEC ( UInt szB ) {
+   tl_assert(szB / sizeof(UWord) <= N_RCEC_POOLS);
+   return VG_(allocEltPA) ( rcec_pool_allocators[szB / sizeof(UWord)] );
 }
 
 static void free_RCEC ( RCEC* rcec ) {
    tl_assert(rcec->magic == RCEC_MAGIC);
-   VG_(freeEltPA)( rcec_pool_allocator, rcec );
+   VG_(freeEltPA)( rcec_pool_allocators[rcec->szB / sizeof(UWord)], rcec );
 }
 //////////// END RCEC pool allocator
 
+/* Encode the non-zero prefix of frames[0 .. N_FRAMES-1] into 'ec'. */
+static void RCEC__encode_frames ( RCEC* ec, const UWord* frames )
+{
+   UInt  i, n = 0;
+   UWord prev = 0;
+   for (i = 0; i < N_FRAMES && frames[i] != 0; i++) {
+      Word  d  = (Word)(frames[i] - prev);
+      UWord zz = ((UWord)d << 1) ^ (UWord)(d >> (8 * sizeof(Word) - 1));
+      while (zz >= 0x80) {
+         ec->frames_enc[n++] = (UChar)(zz | 0x80);
+         zz >>= 7;
+      }
+      ec->frames_enc[n++] = (UChar)zz;
+      prev = frames[i];
+   }
+   tl_assert(n <= RCEC_MAX_ENC_SZB);
+   ec->nFrames = i;
+   ec->encSzB  = n;
+}
+
+/* Decode the frames of 'ec' into frames[0 .. N_FRAMES-1], and return
+   the number of non-zero frames. */
+static UInt RCEC__get_frames ( const RCEC* ec, /*OUT*/UWord* frames )
+{
+   UInt  i, n = 0;
+   UWord prev = 0;
+   for (i = 0; i < ec->nFrames; i++) {
+      UWord zz = 0;
+      Int   shift = 0;
+      UChar b;
+      do {
+         b = ec->frames_enc[n++];
+         zz |= (UWord)(b & 0x7F) << shift;
+         shift += 7;
+      } while (b & 0x80);
+      prev += (zz >> 1) ^ (UWord)(-(Word)(zz & 1));
+      frames[i] = prev;
+   }
+   tl_assert(n == ec->encSzB);
+   for (; i < N_FRAMES; i++)
+      frames[i] = 0;
+   return ec->nFrames;
+}
+
 static RCEC** contextTab = NULL; /* hash table of RCEC*s */
 
 /* Count of allocated RCEC having ref count > 0 */
 static UWord RCEC_referenced = 0;
 
-/* Gives an arbitrary total order on RCEC .frames fields */
+/* Bytes in all allocated RCECs, and in those having ref count > 0 */
+static UWord RCEC_szB_curr = 0;
+static UWord RCEC_szB_referenced = 0;
+
+/* Gives an arbitrary total order on RCEC .frames_enc fields */
 static Word RCEC__cmp_by_frames ( RCEC* ec1, RCEC* ec2 ) {
-   Word i;
+   Int r;
    tl_assert(ec1 && ec1->magic == RCEC_MAGIC);
    tl_assert(ec2 && ec2->magic == RCEC_MAGIC);
    if (ec1->frames_hash < ec2->frames_hash) return -1;
    if (ec1->frames_hash > ec2->frames_hash) return  1;
-   for (i = 0; i < N_FRAMES; i++) {
-      if (ec1->frames[i] < ec2->frames[i]) return -1;
-      if (ec1->frames[i] > ec2->frames[i]) return  1;
-   }
-   return 0;
+   if (ec1->encSzB < ec2->encSzB) return -1;
+   if (ec1->encSzB > ec2->encSzB) return  1;
+   r = VG_(memcmp)(ec1->frames_enc, ec2->frames_enc, ec1->encSzB);
+   return r < 0 ? -1 : r > 0 ? 1 : 0;
 }
 
 
@@ -4292,19 +4444,22 @@ static void ctxt__rcdec ( RCEC* ec )
    tl_assert(ec && ec->magic == RCEC_MAGIC);
    tl_assert(ec->rc > 0);
    ec->rc--;
-   if (ec->rc == 0) 
+   if (ec->rc == 0) {
       RCEC_referenced--;
+      RCEC_szB_referenced -= ec->szB;
+   }
 }
 
 static void ctxt__rcinc ( RCEC* ec )
 {
    tl_assert(ec && ec->magic == RCEC_MAGIC);
-   if (ec->rc == 0) 
+   if (ec->rc == 0) {
       RCEC_referenced++;
+      RCEC_szB_referenced += ec->szB;
+   }
    ec->rc++;
 }
 
-
 /* Find 'ec' in the RCEC list whose head pointer lives at 'headp' and
    move it one step closer to the front of the list, so as to make
    subsequent searches for it cheaper. */
@@ -4383,14 +4538,17 @@ static RCEC* ctxt__find_or_add ( RCEC* example )
          move_RCEC_one_step_forward( &contextTab[hent], copy );
       }
    } else {
-      copy = alloc_RCEC();
+      UInt szB = RCEC_szB_for_enc(example->encSzB);
+      copy = alloc_RCEC(szB);
       tl_assert(copy != example);
-      *copy = *example;
+      VG_(memcpy)(copy, example, sizeof(RCEC) + example->encSzB);
+      copy->szB = szB;
       copy->next = contextTab[hent];
       contextTab[hent] = copy;
       stats__ctxt_tab_curr++;
       if (stats__ctxt_tab_curr > stats__ctxt_tab_max)
          stats__ctxt_tab_max = stats__ctxt_tab_curr;
+      RCEC_szB_curr += szB;
    }
    return copy;
 }
@@ -4406,19 +4564,23 @@ __attribute__((noinline))
 static RCEC* get_RCEC ( Thr* thr )
 {
    UWord hash, i;
-   RCEC  example;
-   example.magic = RCEC_MAGIC;
-   example.rc = 0;
-   example.rcX = 0;
-   example.next = NULL;
-   main_get_stacktrace( thr, &example.frames[0], N_FRAMES );
+   UWord frames[N_FRAMES];
+   UWord space[RCEC_MAX_SZB / sizeof(UWord) + 1];
+   RCEC* example = (RCEC*)space;
+   example->magic = RCEC_MAGIC;
+   example->rc = 0;
+   example->rcX = 0;
+   example->szB = 0;
+   example->next = NULL;
+   main_get_stacktrace( thr, &frames[0], N_FRAMES );
    hash = 0;
    for (i = 0; i < N_FRAMES; i++) {
-      hash ^= example.frames[i];
+      hash ^= frames[i];
       hash = ROLW(hash, 19);
    }
-   example.frames_hash = hash;
-   return ctxt__find_or_add( &example );
+   example->frames_hash = hash;
+   RCEC__encode_frames( example, frames );
+   return ctxt__find_or_add( example );
 }
 
 ///////////////////////////////////////////////////////
@@ -4438,12 +4600,15 @@ static RCEC* get_RCEC ( Thr* thr )
    This allows to use a TSW as a fully initialised UInt e.g. in
    cmp_oldref_tsw. If needed, a more compact representation of szB
    can be done (e.g. use only 4 bits, or use only 2 bits and encode the
-   size (1,2,4,8) as 00 = 1, 01 = 2, 10 = 4, 11 = 8. */
+   size (1,2,4,8) as 00 = 1, 01 = 2, 10 = 4, 11 = 8.
+   isP is not part of the access: it says which of the two OldRef
+   lists the record is on, and is ignored by cmp_oldref_tsw. */
 typedef 
    struct {
       UInt      thrid  : SCALARTS_N_THRBITS;
-      UInt      szB    : 32 - SCALARTS_N_THRBITS - 1;
+      UInt      szB    : 32 - SCALARTS_N_THRBITS - 2;
       UInt      isW    : 1;
+      UInt      isP    : 1;
    } TSW; // Thread+Size+Writeness
 typedef
    struct {
@@ -4464,10 +4629,12 @@ typedef
    }
    OldRef;
 
-/* Returns the or->tsw as an UInt */
+/* Returns the or->tsw as an UInt, without the isP bit */
 static inline UInt oldref_tsw (const OldRef* or)
 {
-   return *(const UInt*)(&or->acc.tsw);
+   TSW tsw = or->acc.tsw;
+   tsw.isP = 0;
+   return *(const UInt*)(&tsw);
 }
 
 /* Compare the tsw component for 2 OldRef.
@@ -4492,16 +4659,26 @@ static PoolAlloc* oldref_pool_allocator;
 
 static OldRef mru; 
 static OldRef lru; 
-// A double linked list, chaining all OldREf in a mru/lru order.
-// mru/lru are sentinel nodes.
-// Whenever an oldref is re-used, its position is changed as the most recently
-// used (i.e. pointed to by mru.prev).
+static OldRef mru_p;
+static OldRef lru_p;
+// Two double linked lists, each chaining OldRefs in a mru/lru order.
+// mru/lru and mru_p/lru_p are their sentinel nodes.
+// The first list (the 'probation' list) holds the OldRefs which have
+// only been bound once.  The second (the 'protected' list, for which
+// acc.tsw.isP is set) holds those which have been bound again since.
+// Whenever an oldref is re-used, it is moved to be the most recently
+// used of the protected list (i.e. pointed to by mru_p.prev).
 // When a new oldref is needed, it is allocated from the pool
-//  if we have not yet reached --conflict-cache-size.
-// Otherwise, if all oldref have already been allocated,
-// the least recently used (i.e. pointed to by lru.next) is re-used.
-// When an OldRef is used, it is moved as the most recently used entry
-// (i.e. pointed to by mru.prev).
+//  if we have not yet reached --conflict-cache-size or --history-budget.
+// Otherwise, the least recently used of the probation list (i.e. pointed
+// to by lru.next) is re-used, unless that list holds less than a quarter
+// of the OldRefs, in which case the least recently used protected OldRef
+// is re-used.
+// A new OldRef is made the most recently used entry of the probation
+// list (i.e. pointed to by mru.prev).
+// So a stream of accesses each done only once, such as a memset of a
+// big block, can only push out other single accesses, and the
+// history of locations accessed over and over stays in the map.
 
 // Removes r from the double linked list
 // Note: we do not need to test for special cases such as
@@ -4514,42 +4691,90 @@ static inline void OldRef_unchain(OldRef *r)
    r->prev->next = r->next;
 }
 
-// Insert new as the newest OldRef
+// Insert new as the newest OldRef of the list with sentinel node m.
 // Similarly to OldRef_unchain, no need to test for NULL
 // pointers, as e.g. mru.prev is always guaranteed to point
 // to a non NULL node (lru when the list is empty).
-static inline void OldRef_newest(OldRef *new)
+static inline void OldRef_newest(OldRef *new, OldRef *m)
 {
-   new->next = &mru;
-   new->prev = mru.prev;
-   mru.prev = new;
+   new->next = m;
+   new->prev = m->prev;
+   m->prev = new;
    new->prev->next = new;
 }
 
 
 static VgHashTable* oldrefHT    = NULL; /* Hash table* OldRef* */
 static UWord     oldrefHTN    = 0;    /* # elems in oldrefHT */
+static UWord     oldrefHTN_P  = 0;    /* # of those in the protected list */
 /* Note: the nr of ref in the oldrefHT will always be equal to
    the nr of elements that were allocated from the OldRef pool allocator
-   as we never free an OldRef : we just re-use them. */
+   and not given back to it.  We only give OldRefs back to the pool when
+   going over --history-budget. */
 
+static UWord stats__oldref_evict_P = 0;
+static UWord stats__oldref_evict_notP = 0;
+static UWord stats__oldref_budget_frees = 0;
 
-/* allocates a new OldRef or re-use the lru one if all allowed OldRef
+/* Memory used for the history, as limited by --history-budget: the
+   OldRefs and the RCECs they refer to. */
+static inline UWord history_szB ( void )
+{
+   return oldrefHTN * sizeof(OldRef) + RCEC_szB_referenced;
+}
+
+static inline Bool history_over_budget ( UWord extra_szB )
+{
+   return HG_(clo_history_budget) > 0
+          && (ULong)(history_szB() + extra_szB)
+                > (ULong)HG_(clo_history_budget) * 1024 * 1024;
+}
+
+/* Takes the OldRef to be discarded out of the lists and the oldrefHT,
+   and returns it. */
+static OldRef* evict_OldRef ( void )
+{
+   OldRef *oldref_ht;
+   OldRef *oldref;
+
+   if (oldrefHTN_P == 0 || oldrefHTN - oldrefHTN_P > oldrefHTN / 4) {
+      oldref = lru.next;
+      stats__oldref_evict_notP++;
+   } else {
+      oldref = lru_p.next;
+      oldrefHTN_P--;
+      stats__oldref_evict_P++;
+   }
+   tl_assert (oldref != &mru && oldref != &mru_p);
+   OldRef_unchain(oldref);
+   oldref_ht = VG_(HT_gen_remove) (oldrefHT, oldref, cmp_oldref_tsw);
+   tl_assert (oldref == oldref_ht);
+   ctxt__rcdec( oldref->acc.rcec );
+   return oldref;
+}
+
+/* allocates a new OldRef or re-use an old one if all allowed OldRef
    have already been allocated. */
 static OldRef* alloc_or_reuse_OldRef ( void )
 {
-   if (oldrefHTN < HG_(clo_conflict_cache_size)) {
+   if (oldrefHTN < HG_(clo_conflict_cache_size)
+       && !history_over_budget(sizeof(OldRef))) {
       oldrefHTN++;
       return VG_(allocEltPA) ( oldref_pool_allocator );
    } else {
-      OldRef *oldref_ht;
-      OldRef *oldref = lru.next;
+      return evict_OldRef();
+   }
+}
 
-      OldRef_unchain(oldref);
-      oldref_ht = VG_(HT_gen_remove) (oldrefHT, oldref, cmp_oldref_tsw);
-      tl_assert (oldref == oldref_ht);
-      ctxt__rcdec( oldref->acc.rcec );
-      return oldref;
+/* If the history has gone over --history-budget, because of RCECs
+   with more frames or fewer shared ones, give OldRefs back to the
+   pool until it fits again. */
+static void trim_OldRefs_to_budget ( void )
+{
+   while (oldrefHTN > 1 && history_over_budget(0)) {
+      VG_(freeEltPA) ( oldref_pool_allocator, evict_OldRef() );
+      oldrefHTN--;
+      stats__oldref_budget_frees++;
    }
 }
 
@@ -4625,7 +4850,11 @@ static void event_map_bind ( Addr a, SizeT szB, Bool isW, Thr* thr )
       ref->acc.locksHeldW = locksHeldW;
 
       OldRef_unchain(ref);
-      OldRef_newest(ref);
+      if (!ref->acc.tsw.isP) {
+         ref->acc.tsw.isP = 1;
+         oldrefHTN_P++;
+      }
+      OldRef_newest(ref, &mru_p);
 
    } else {
       /* We don't have a record for this address+triple.  Create a new one. */
@@ -4641,7 +4870,9 @@ static void event_map_bind ( Addr a, SizeT szB, Bool isW, Thr* thr )
       ctxt__rcinc(rcec);
 
       VG_(HT_add_node) ( oldrefHT, ref );
-      OldRef_newest (ref);
+      OldRef_newest (ref, &mru);
+      if (UNLIKELY(HG_(clo_history_budget) > 0))
+         trim_OldRefs_to_budget();
    }
    event_map_stamp++;
 }
@@ -4726,7 +4957,8 @@ Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
 
       if (ref) {
          /* return with success */
-         Int n, maxNFrames;
+         UInt n, maxNFrames;
+         UWord     frames[N_FRAMES];
          RCEC*     ref_rcec = ref->acc.rcec;
          tl_assert(ref->acc.tsw.thrid);
          tl_assert(ref_rcec);
@@ -4734,11 +4966,8 @@ Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
          tl_assert(ref_szB >= 1);
          /* Count how many non-zero frames we have. */
          maxNFrames = min_UInt(N_FRAMES, VG_(clo_backtrace_size));
-         for (n = 0; n < maxNFrames; n++) {
-            if (0 == ref_rcec->frames[n]) break;
-         }
-         *resEC      = VG_(make_ExeContext_from_StackTrace)(ref_rcec->frames,
-                                                            n);
+         n = min_UInt(RCEC__get_frames(ref_rcec, frames), maxNFrames);
+         *resEC      = VG_(make_ExeContext_from_StackTrace)(frames, n);
          *resThr     = Thr__from_ThrID(ref->acc.tsw.thrid);
          *resSzB     = ref_szB;
          *resIsW     = ref->acc.tsw.isW;
@@ -4758,30 +4987,42 @@ Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
 
 void libhb_event_map_access_history ( Addr a, SizeT szB, Access_t fn )
 {
-   OldRef *ref = lru.next;
+   OldRef *ref_n = lru.next;   /* oldest in the probation list */
+   OldRef *ref_p = lru_p.next; /* oldest in the protected list */
+   OldRef *ref;
    SizeT ref_szB;
+   UWord frames[N_FRAMES];
    Int n;
-      
-   while (ref != &mru) {
+
+   /* Visit the OldRefs of both lists from oldest to newest, by merging
+      them on their stamps. */
+   while (ref_n != &mru || ref_p != &mru_p) {
+      if (ref_p == &mru_p
+          || (ref_n != &mru
+              && (ref_n->stamp - event_map_stamp)
+                    < (ref_p->stamp - event_map_stamp))) {
+         ref = ref_n;
+         ref_n = ref_n->next;
+         tl_assert (ref_n == &mru
+                    || ((ref->stamp - event_map_stamp)
+                           < ref_n->stamp - event_map_stamp));
+      } else {
+         ref = ref_p;
+         ref_p = ref_p->next;
+         tl_assert (ref_p == &mru_p
+                    || ((ref->stamp - event_map_stamp)
+                           < ref_p->stamp - event_map_stamp));
+      }
       ref_szB = ref->acc.tsw.szB;
       if (cmp_nonempty_intervals(a, szB, ref->ga, ref_szB) == 0) {
-         RCEC* ref_rcec = ref->acc.rcec;
-         for (n = 0; n < N_FRAMES; n++) {
-            if (0 == ref_rcec->frames[n]) {
-               break;
-            }
-         }
-         (*fn)(ref_rcec->frames, n,
+         n = RCEC__get_frames(ref->acc.rcec, frames);
+         (*fn)(frames, n,
                Thr__from_ThrID(ref->acc.tsw.thrid),
                ref->ga,
                ref_szB,
                ref->acc.tsw.isW,
                ref->acc.locksHeldW);
       }
-      tl_assert (ref->next == &mru
-                 || ((ref->stamp - event_map_stamp)
-                        < ref->next->stamp - event_map_stamp));
-      ref = ref->next;
    }
 }
 
@@ -4789,14 +5030,15 @@ static void event_map_init ( void )
 {
    Word i;
 
-   /* Context (RCEC) pool allocator */
-   rcec_pool_allocator = VG_(newPA) (
-                             sizeof(RCEC),
-                             1000 /* RCECs per pool */,
-                             HG_(zalloc),
-                             "libhb.event_map_init.1 (RCEC pools)",
-                             HG_(free)
-                          );
+   /* Context (RCEC) pool allocators */
+   for (i = RCEC_szB_for_enc(0) / sizeof(UWord); i <= N_RCEC_POOLS; i++)
+      rcec_pool_allocators[i] = VG_(newPA) (
+                                   i * sizeof(UWord),
+                                   1000 /* RCECs per pool */,
+                                   HG_(zalloc),
+                                   "libhb.event_map_init.1 (RCEC pools)",
+                                   HG_(free)
+                                );
 
    /* Context table */
    tl_assert(!contextTab);
@@ -4829,6 +5071,11 @@ static void event_map_init ( void )
                            .locksHeldW = 0, 
                            .rcec = NULL};
    lru.acc = mru.acc;
+   oldrefHTN_P = 0;
+   mru_p = mru;
+   lru_p = lru;
+   mru_p.prev = &lru_p;
+   lru_p.next = &mru_p;
 }
 
 static void event_map__check_reference_counts ( void )
@@ -4900,6 +5147,7 @@ static void do_RCEC_GC ( void )
       while (p) {
          if (p->rc == 0) {
             *pp = p->next;
+            RCEC_szB_curr -= p->szB;
             free_RCEC(p);
             p = *pp;
             tl_assert(stats__ctxt_tab_curr > 0);
@@ -5119,11 +5367,11 @@ static inline SVal msmcread ( SVal svOld,
       VtsID tviW  = acc_thr->viW;
       VtsID rmini = SVal__unC_Rmin(svOld);
       VtsID wmini = SVal__unC_Wmin(svOld);
-      Bool  leq   = VtsID__cmpLEQ(rmini,tviR);
+      Bool  leq   = VtsID__cmpLEQ_thrR(rmini, acc_thr);
       if (LIKELY(leq)) {
          /* no race */
          /* Note: RWLOCK subtlety: use tviW, not tviR */
-         svNew = SVal__mkC( rmini, VtsID__join2(wmini, tviW) );
+         svNew = SVal__mkC( rmini, VtsID__join2_thrW(wmini, acc_thr) );
          goto out;
       } else {
          /* assert on sanity of constraints. */
@@ -5182,7 +5430,7 @@ static inline SVal msmcwrite ( SVal svOld,
    if (LIKELY(SVal__isC(svOld))) {
       VtsID tviW  = acc_thr->viW;
       VtsID wmini = SVal__unC_Wmin(svOld);
-      Bool  leq   = VtsID__cmpLEQ(wmini,tviW);
+      Bool  leq   = VtsID__cmpLEQ_thrW(wmini, acc_thr);
       if (LIKELY(leq)) {
          /* no race */
          svNew = SVal__mkC( tviW, tviW );
@@ -6228,9 +6476,9 @@ Thr* libhb_init (
 
    /* because first 1024 unusable */
    STATIC_ASSERT(SCALARTS_N_THRBITS >= 11);
-   /* so as to fit in a UInt w/ 5 bits to spare (see defn of
+   /* so as to fit in a UInt w/ 6 bits to spare (see defn of
       Thr_n_RCEC and TSW). */
-   STATIC_ASSERT(SCALARTS_N_THRBITS <= 27);
+   STATIC_ASSERT(SCALARTS_N_THRBITS <= 26);
 
    /* Need to be sure that Thr_n_RCEC is 2 words (64-bit) or 3 words
       (32-bit).  It's not correctness-critical, but there are a lot of
@@ -6397,8 +6645,10 @@ void libhb_shutdown ( Bool show_stats )
                   stats__msmcread, stats__msmcread_change);
       VG_(printf)("   libhb: %'13llu msmcwrite (%'llu dragovers)\n",
                   stats__msmcwrite, stats__msmcwrite_change);
-      VG_(printf)("   libhb: %'13llu cmpLEQ queries (%'llu misses)\n",
-                  stats__cmpLEQ_queries, stats__cmpLEQ_misses);
+      VG_(printf)("   libhb: %'13llu cmpLEQ queries (%'llu misses)"
+                  " + %'llu per-thread hits\n",
+                  stats__cmpLEQ_queries, stats__cmpLEQ_misses,
+                  stats__cmpLEQ_thr_hits);
       VG_(printf)("   libhb: %'13llu join2  queries (%'llu misses)\n",
                   stats__join2_queries, stats__join2_misses);
 
@@ -6459,8 +6709,14 @@ void libhb_shutdown ( Bool show_stats )
       }
 
       VG_(printf)("%s","\n");
-      VG_(printf)( "   libhb: oldrefHTN %lu (%'d bytes)\n",
-                   oldrefHTN, (int)(oldrefHTN * sizeof(OldRef)));
+      VG_(printf)( "   libhb: oldrefHTN %lu (%'d bytes),"
+                   " %lu protected\n",
+                   oldrefHTN, (int)(oldrefHTN * sizeof(OldRef)),
+                   oldrefHTN_P);
+      VG_(printf)( "   libhb: oldref evictions protected=%'lu"
+                   " probation=%'lu, freed for budget %'lu\n",
+                   stats__oldref_evict_P, stats__oldref_evict_notP,
+                   stats__oldref_budget_frees);
       tl_assert (oldrefHTN == VG_(HT_count_nodes) (oldrefHT));
       VG_(printf)( "   libhb: oldref lookup found=%lu notfound=%lu\n",
                    stats__evm__lookup_found, stats__evm__lookup_notfound);
@@ -6478,6 +6734,12 @@ void libhb_shutdown ( Bool show_stats )
                    (UWord)N_RCEC_TAB,
                    stats__ctxt_tab_curr, RCEC_referenced,
                    stats__ctxt_tab_max );
+      VG_(printf)( "   libhb: contextTab: %'lu bytes (ref'd %'lu),"
+                   " history %'lu bytes",
+                   RCEC_szB_curr, RCEC_szB_referenced, history_szB() );
+      if (HG_(clo_history_budget) > 0)
+         VG_(printf)( " (budget %'lu MB)", HG_(clo_history_budget) );
+      VG_(printf)( "\n");
       {
 #        define  MAXCHAIN 10
          UInt chains[MAXCHAIN+1]; // [MAXCHAIN] gets all chains >= MAXCHAIN
@@ -7060,10 +7322,15 @@ void libhb_maybe_GC ( void )
      and (3) the nr of referenced RCECs is less than 75% than total nr RCECs.
      Avoid growing too much the nr of RCEC keeps the memory use low,
      and avoids to have too many elements in the (fixed) contextTab hashtable.
+     Also GC them when, with --history-budget, they use more than an
+     eighth of the budget, as they are not counted in it.
    */
-   if (UNLIKELY(stats__ctxt_tab_curr > N_RCEC_TAB/2
-                && stats__ctxt_tab_curr + 1000 >= stats__ctxt_tab_max
-                && (stats__ctxt_tab_curr * 3)/4 > RCEC_referenced))
+   if (UNLIKELY((stats__ctxt_tab_curr > N_RCEC_TAB/2
+                 && stats__ctxt_tab_curr + 1000 >= stats__ctxt_tab_max
+                 && (stats__ctxt_tab_curr * 3)/4 > RCEC_referenced)
+                || (HG_(clo_history_budget) > 0
+                    && (ULong)(RCEC_szB_curr - RCEC_szB_referenced)
+                          > (ULong)HG_(clo_history_budget) * 1024 * 1024 / 8)))
       do_RCEC_GC();
 
    /* If there are still no entries available (all the table entries are full),
@@ -0,0 +1,67 @@
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../../helgrind/helgrind.h"
+
+/* Test for --history-budget.  The child writes 'prot' in several
+   segments, so that its history entry is moved to the protected list,
+   and writes 'once' just once.  It then writes every element of
+   'flood' once, which with a small budget evicts many of the older
+   history entries.  The parent then races on both variables.  The
+   race on 'prot' still shows the child's conflicting write, whose
+   stack has been through the compressed history and back.  The entry
+   for 'once' has been evicted, so that race is reported without the
+   conflicting access. */
+
+#define N_FLOOD 100000
+
+int prot;
+int once;
+int flood[N_FLOOD];
+
+/* Lets the parent wait for the child without creating a
+   happens-before relation between them. */
+volatile int child_done;
+
+pthread_mutex_t mx = PTHREAD_MUTEX_INITIALIZER;
+
+void* child_fn ( void* arg )
+{
+   int i;
+   for (i = 0; i < 4; i++) {
+      /* Each unlock starts a new segment of the child. */
+      prot = i;
+      pthread_mutex_lock(&mx);
+      pthread_mutex_unlock(&mx);
+   }
+   once = 1;
+   for (i = 0; i < N_FLOOD; i++)
+      flood[i] = i;
+   child_done = 1;
+   return NULL;
+}
+
+int main ( void )
+{
+   pthread_t child;
+   VALGRIND_HG_DISABLE_CHECKING(&child_done, sizeof(child_done));
+   if (pthread_create(&child, NULL, child_fn, NULL)) {
+      perror("pthread_create");
+      exit(1);
+   }
+   while (!child_done)
+      sched_yield();
+
+   /* Unprotected relative to child */
+   prot = 10;
+   once = 10;
+
+   if (pthread_join(child, NULL)) {
+      perror("pthread join");
+      exit(1);
+   }
+
+   return 0;
+}
@@ -0,0 +1,47 @@
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Test for --race-sampling.  The child writes one element of arr,
+   and then the parent writes all of them in a loop, with no locking.
+   The racing write is in iteration RACY, long after the loop body
+   has used up its cold and first few sampled executions, and outside
+   any later burst, so it is missed with the default sampling rate.
+   With --race-sampling-rate=1 every execution is checked and the race
+   is reported. */
+
+#define N    20000
+#define RACY 15000
+
+int arr[N];
+
+void* child_fn ( void* arg )
+{
+   /* Unprotected relative to parent */
+   arr[RACY] = 1;
+   return NULL;
+}
+
+int main ( void )
+{
+   const struct timespec delay = { 0, 100 * 1000 * 1000 };
+   pthread_t child;
+   int i;
+   if (pthread_create(&child, NULL, child_fn, NULL)) {
+      perror("pthread_create");
+      exit(1);
+   }
+   nanosleep(&delay, 0);
+   /* Unprotected relative to child, in iteration RACY */
+   for (i = 0; i < N; i++)
+      arr[i] = i;
+
+   if (pthread_join(child, NULL)) {
+      perror("pthread join");
+      exit(1);
+   }
+
+   return 0;
+}
@@ -0,0 +1,51 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/* Takes a pair of locks in the same order many times, and then once
+   in the opposite order, which is the only lock order error.  Until
+   then the lock order graph has a topological order, which prunes
+   the search done at each acquisition.  The inversion makes the graph
+   cyclic.  Destroying one of the pair makes it acyclic again, and
+   after a few more searches its order is recomputed, so that the
+   searches over a longer chain of locks are pruned again. */
+
+int main ( void )
+{
+   int r, i;
+   pthread_mutex_t mx1, mx2, mx3, mx4;
+   r = pthread_mutex_init( &mx1, NULL ); assert(r==0);
+   r = pthread_mutex_init( &mx2, NULL ); assert(r==0);
+   r = pthread_mutex_init( &mx3, NULL ); assert(r==0);
+   r = pthread_mutex_init( &mx4, NULL ); assert(r==0);
+
+   for (i = 0; i < 10; i++) {
+      r = pthread_mutex_lock( &mx1 ); assert(r==0);
+      r = pthread_mutex_lock( &mx2 ); assert(r==0);
+      r = pthread_mutex_unlock( &mx2 ); assert(r==0);
+      r = pthread_mutex_unlock( &mx1 ); assert(r==0);
+   }
+
+   r = pthread_mutex_lock( &mx2 ); assert(r==0); /* error */
+   r = pthread_mutex_lock( &mx1 ); assert(r==0);
+   r = pthread_mutex_unlock( &mx1 ); assert(r==0);
+   r = pthread_mutex_unlock( &mx2 ); assert(r==0);
+
+   r = pthread_mutex_destroy( &mx1 ); assert(r==0);
+
+   for (i = 0; i < 10; i++) {
+      r = pthread_mutex_lock( &mx2 ); assert(r==0);
+      r = pthread_mutex_lock( &mx3 ); assert(r==0);
+      r = pthread_mutex_lock( &mx4 ); assert(r==0);
+      r = pthread_mutex_unlock( &mx4 ); assert(r==0);
+      r = pthread_mutex_unlock( &mx3 ); assert(r==0);
+      r = pthread_mutex_unlock( &mx2 ); assert(r==0);
+   }
+
+   r = pthread_mutex_destroy( &mx2 ); assert(r==0);
+   r = pthread_mutex_destroy( &mx3 ); assert(r==0);
+   r = pthread_mutex_destroy( &mx4 ); assert(r==0);
+
+   return 0;
+}
@@ -497,6 +497,24 @@ extern void VG_(needs_xml_output) ( void );
    function here. */
 extern void VG_(needs_final_IR_tidy_pass) ( IRSB*(*final_tidy)(IRSB*) );
 
+/* Can the tool run code from the shared objects named by
+   --uninstrumented-objects= without instrumenting it fully?  If so,
+   specify a function to use in place of the normal instrument
+   function for superblocks in those objects.  It should do no
+   checking or profiling, only the minimum needed to keep the tool's
+   shadow state consistent with what the code does.  The core does not
+   chase between such code and normally-instrumented code, so a
+   superblock is always entirely one or the other. */
+extern void VG_(needs_uninstrumented_objects) (
+   IRSB*(*instrument)(VgCallbackClosure* closure,
+                      IRSB*              sb_in,
+                      const VexGuestLayout*  layout,
+                      const VexGuestExtents* vge,
+                      const VexArchInfo*     archinfo_host,
+                      IRType             gWordTy,
+                      IRType             hWordTy)
+);
+
 
 /* ------------------------------------------------------------------ */
 /* Core events to track */
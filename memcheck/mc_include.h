@@ -496,8 +496,9 @@ extern HChar * MC_(snprintf_delta) (HChar * buf, Int size,
                                     LeakCheckDeltaMode delta_mode);
 
 
-Bool MC_(is_valid_aligned_word)     ( Addr a );
-Bool MC_(is_within_valid_secondary) ( Addr a );
+Bool MC_(is_valid_aligned_word)       ( Addr a );
+Bool MC_(is_within_valid_secondary)   ( Addr a );
+Bool MC_(is_within_defined_secondary) ( Addr a );
 
 // Prints as user msg a description of the given loss record.
 void MC_(pp_LossRecord)(UInt n_this_record, UInt n_total_records,
@@ -722,6 +723,10 @@ extern Bool MC_(clo_show_mismatched_frees);
    operations? Default: NO */
 extern Bool MC_(clo_expensive_definedness_checks);
 
+/* Should we free secondary maps which have become uniform?  Default:
+   YES */
+extern Bool MC_(clo_reclaim_shadow_memory);
+
 /* Do we have a range of stack offsets to ignore?  Default: NO */
 extern Bool MC_(clo_ignore_range_below_sp);
 extern UInt MC_(clo_ignore_range_below_sp__first_offset);
@@ -773,6 +778,10 @@ VG_REGPARM(1) UWord MC_(helperc_LOADV16be)  ( Addr );
 VG_REGPARM(1) UWord MC_(helperc_LOADV16le)  ( Addr );
 VG_REGPARM(1) UWord MC_(helperc_LOADV8)     ( Addr );
 
+/* Where the primary map is, for the inline fast cases of the above
+   generated by mc_translate.c.  NULL if those shouldn't be used. */
+void* MC_(get_primary_map) ( /*OUT*/UWord* n_entries );
+
 VG_REGPARM(3)
 void MC_(helperc_MAKE_STACK_UNINIT_w_o) ( Addr base, UWord len, Addr nia );
 
@@ -804,7 +813,15 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
                         const VexArchInfo* archinfo_host,
                         IRType gWordTy, IRType hWordTy );
 
+IRSB* MC_(instrument_uninstrumented) ( VgCallbackClosure* closure,
+                                       IRSB* bb_in,
+                                       const VexGuestLayout* layout,
+                                       const VexGuestExtents* vge,
+                                       const VexArchInfo* archinfo_host,
+                                       IRType gWordTy, IRType hWordTy );
+
 IRSB* MC_(final_tidy) ( IRSB* );
+void  MC_(print_tidy_stats) ( void );
 
 /* Check some assertions to do with the instrumentation machinery. */
 void MC_(do_instrumentation_startup_checks)( void );
@@ -338,10 +338,10 @@ find_active_chunks(Int* pn_chunks)
 {
    // Our goal is to construct a set of chunks that includes every
    // mempool chunk, and every malloc region that *doesn't* contain a
-   // mempool chunk.
+   // mempool chunk.  The set is returned sorted by address.
    MC_Mempool *mp;
-   MC_Chunk **mallocs, **chunks, *mc;
-   UInt n_mallocs, n_chunks, m, s;
+   MC_Chunk **mallocs, **pool_chunks, **chunks, *mc;
+   UInt n_mallocs, n_pool_chunks, n_chunks, m, p, s;
    Bool *malloc_chunk_holds_a_pool_chunk;
 
    // First we collect all the malloc chunks into an array and sort it.
@@ -360,6 +360,7 @@ find_active_chunks(Int* pn_chunks)
    malloc_chunk_holds_a_pool_chunk = VG_(calloc)( "mc.fas.1",
                                                   n_mallocs, sizeof(Bool) );
    n_chunks = n_mallocs;
+   n_pool_chunks = 0;
 
    // Then we loop over the mempool tables. For each chunk in each
    // pool, we set the entry in the Bool array corresponding to the
@@ -371,6 +372,7 @@ find_active_chunks(Int* pn_chunks)
 
          // We'll need to record this chunk.
          n_chunks++;
+         n_pool_chunks++;
 
          // Possibly invalidate the malloc holding the beginning of this chunk.
          m = find_chunk_for(mc->data, mallocs, n_mallocs);
@@ -393,30 +395,54 @@ find_active_chunks(Int* pn_chunks)
    }
    tl_assert(n_chunks > 0);
 
+   // Collect the mempool chunks and sort them as well.  There are
+   // usually far fewer of these than malloc chunks.
+   pool_chunks = NULL;
+   if (n_pool_chunks > 0) {
+      pool_chunks = VG_(malloc)("mc.fas.3",
+                                sizeof(VgHashNode*) * n_pool_chunks);
+      p = 0;
+      VG_(HT_ResetIter)(MC_(mempool_list));
+      while ( (mp = VG_(HT_Next)(MC_(mempool_list))) ) {
+         VG_(HT_ResetIter)(mp->chunks);
+         while ( (mc = VG_(HT_Next)(mp->chunks)) ) {
+            tl_assert(p < n_pool_chunks);
+            pool_chunks[p++] = mc;
+         }
+      }
+      tl_assert(p == n_pool_chunks);
+      VG_(ssort)(pool_chunks, n_pool_chunks, sizeof(VgHashNode*),
+                 compare_MC_Chunks);
+   }
+
    // Create final chunk array.
    chunks = VG_(malloc)("mc.fas.2", sizeof(VgHashNode*) * (n_chunks));
    s = 0;
 
-   // Copy the mempool chunks and the non-marked malloc chunks into a
-   // combined array of chunks.
-   VG_(HT_ResetIter)(MC_(mempool_list));
-   while ( (mp = VG_(HT_Next)(MC_(mempool_list))) ) {
-      VG_(HT_ResetIter)(mp->chunks);
-      while ( (mc = VG_(HT_Next)(mp->chunks)) ) {
-         tl_assert(s < n_chunks);
-         chunks[s++] = mc;
-      }
-   }
-   for (m = 0; m < n_mallocs; ++m) {
-      if (!malloc_chunk_holds_a_pool_chunk[m]) {
-         tl_assert(s < n_chunks);
-         chunks[s++] = mallocs[m];
-      }
+   // Merge the mempool chunks and the non-marked malloc chunks into a
+   // combined array of chunks.  Since both inputs are sorted, so is the
+   // result.  This saves sorting everything a second time, which is a
+   // noticeable part of the cost of a leak search on big heaps.
+   m = 0;
+   p = 0;
+   while (True) {
+      while (m < n_mallocs && malloc_chunk_holds_a_pool_chunk[m])
+         m++;
+      if (m == n_mallocs && p == n_pool_chunks)
+         break;
+      tl_assert(s < n_chunks);
+      if (p == n_pool_chunks
+          || (m < n_mallocs && mallocs[m]->data <= pool_chunks[p]->data))
+         chunks[s++] = mallocs[m++];
+      else
+         chunks[s++] = pool_chunks[p++];
    }
    tl_assert(s == n_chunks);
 
    // Free temporaries.
    VG_(free)(mallocs);
+   if (pool_chunks)
+      VG_(free)(pool_chunks);
    VG_(free)(malloc_chunk_holds_a_pool_chunk);
 
    *pn_chunks = n_chunks;
@@ -459,6 +485,12 @@ static MC_Chunk** lc_chunks;
 // How many chunks we're dealing with.
 static Int        lc_n_chunks;
 static SizeT lc_chunks_n_frees_marker;
+// The address range [lc_chunks_lo, lc_chunks_hi) covered by the blocks in
+// lc_chunks.  Most of the words scanned during a leak search are not
+// pointers into the heap at all, and this allows them to be rejected
+// without consulting aspacemgr or searching lc_chunks.
+static Addr lc_chunks_lo;
+static Addr lc_chunks_hi;
 // This has the same number of entries as lc_chunks, and each entry
 // in lc_chunks corresponds with the entry here (ie. lc_chunks[i] and
 // lc_extras[i] describe the same block).
@@ -530,6 +562,10 @@ lc_is_a_chunk_ptr(Addr ptr, Int* pch_no, MC_Chunk** pch, LC_Extra** pex)
    MC_Chunk* ch;
    LC_Extra* ex;
 
+   // Quickest filter: ptr cannot point into a block.
+   if (ptr < lc_chunks_lo || ptr >= lc_chunks_hi)
+      return False;
+
    // Quick filter. Note: implemented with am, not with get_vabits2
    // as ptr might be random data pointing anywhere. On 64 bit
    // platforms, getting va bits for random data can be quite costly
@@ -1059,6 +1095,9 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
    Addr ptr = VG_ROUNDUP(start, sizeof(Addr));
    const Addr end = VG_ROUNDDN(start+len, sizeof(Addr));
    fault_catcher_t prev_catcher;
+   // True if the SM chunk containing ptr is entirely defined, in which
+   // case MC_(is_valid_aligned_word) reduces to the ignored range check.
+   Bool sm_defined;
 
    if (VG_DEBUG_LEAKCHECK)
       VG_(printf)("scan %#lx-%#lx (%lu)\n", start, end, len);
@@ -1089,6 +1128,7 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
    /* The above optimisation and below loop is based on some relationships
       between VKI_PAGE_SIZE, SM_SIZE and sizeof(Addr) which are asserted in
       MC_(detect_memory_leaks). */
+   sm_defined = MC_(is_within_defined_secondary)(ptr);
 
    // See leak_search_fault_catcher
    if (VG_MINIMAL_SETJMP(lc_scan_memory_jmpbuf) != 0) {
@@ -1109,6 +1149,7 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
       tl_assert(bad_scanned_addr < VG_ROUNDDN(start+len, sizeof(Addr)));
       ptr = bad_scanned_addr + sizeof(Addr); // Unaddressable, - skip it.
 #endif
+      sm_defined = MC_(is_within_defined_secondary)(ptr);
    }
    while (ptr < end) {
       Addr addr;
@@ -1119,6 +1160,7 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
             ptr = VG_ROUNDUP(ptr+1, SM_SIZE);
             continue;
          }
+         sm_defined = MC_(is_within_defined_secondary)(ptr);
       }
 
       // Look to see if this page seems reasonable.
@@ -1129,7 +1171,8 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
          }
       }
 
-      if ( MC_(is_valid_aligned_word)(ptr) ) {
+      if ( sm_defined ? !MC_(in_ignored_range)(ptr)
+                      : MC_(is_valid_aligned_word)(ptr) ) {
          lc_scanned_szB += sizeof(Addr);
          // If the below read fails, we will longjmp to the loop begin.
          addr = *(Addr *)ptr;
@@ -2018,6 +2061,7 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
    }
    lc_chunks = find_active_chunks(&lc_n_chunks);
    lc_chunks_n_frees_marker = MC_(get_cmalloc_n_frees)();
+   lc_chunks_lo = lc_chunks_hi = 0;
    if (lc_n_chunks == 0) {
       tl_assert(lc_chunks == NULL);
       if (lr_table != NULL) {
@@ -2036,9 +2080,8 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
       return;
    }
 
-   // Sort the array so blocks are in ascending order in memory.
-   VG_(ssort)(lc_chunks, lc_n_chunks, sizeof(VgHashNode*), compare_MC_Chunks);
-
+   // find_active_chunks has already sorted the array so that blocks are
+   // in ascending order in memory.
    // Sanity check -- make sure they're in order.
    for (i = 0; i < lc_n_chunks-1; i++) {
       tl_assert( lc_chunks[i]->data <= lc_chunks[i+1]->data);
@@ -2143,6 +2186,17 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
       }
    }
 
+   // Work out the range covered by the blocks.  Blocks can overlap (see
+   // above), so the last block does not necessarily end highest.  As in
+   // find_chunk_for, a zero-sized block is treated as having size 1.
+   lc_chunks_lo = lc_chunks[0]->data;
+   for (i = 0; i < lc_n_chunks; i++) {
+      Addr end = lc_chunks[i]->data + lc_chunks[i]->szB
+                 + (lc_chunks[i]->szB == 0 ? 1 : 0);
+      if (end > lc_chunks_hi)
+         lc_chunks_hi = end;
+   }
+
    // Initialise lc_extras.
    if (lc_extras) {
       VG_(free)(lc_extras);
@@ -47,6 +47,7 @@
 #include "pub_tool_replacemalloc.h"
 #include "pub_tool_tooliface.h"
 #include "pub_tool_threadstate.h"
+#include "pub_tool_vki.h"         // VKI_PROT_READ, VKI_PROT_WRITE
 #include "pub_tool_xarray.h"
 #include "pub_tool_xtree.h"
 #include "pub_tool_xtmemory.h"
@@ -299,8 +300,9 @@ static INLINE Bool is_distinguished_sm ( SecMap* sm ) {
    return sm >= &sm_distinguished[0] && sm <= &sm_distinguished[2];
 }
 
-// Forward declaration
+// Forward declarations
 static void update_SM_counts(SecMap* oldSM, SecMap* newSM);
+static void maybe_gcSecMaps(void);
 
 /* dist_sm points to one of our three distinguished secondaries.  Make
    a copy of it so that we can write to it.
@@ -312,6 +314,7 @@ static SecMap* copy_for_writing ( SecMap* dist_sm )
           || dist_sm == &sm_distinguished[1]
           || dist_sm == &sm_distinguished[2]);
 
+   maybe_gcSecMaps();
    new_sm = VG_(am_shadow_alloc)(sizeof(SecMap));
    if (new_sm == NULL)
       VG_(out_of_memory_NORETURN)( "memcheck:allocate new SecMap", 
@@ -334,6 +337,10 @@ static Int   max_undefined_SMs = 0;
 static Int   max_defined_SMs   = 0;
 static Int   max_non_DSM_SMs   = 0;
 
+/* # of secondary map GCs done, and # of secondaries they reclaimed */
+static Int   n_SM_GCs          = 0;
+static Int   n_reclaimed_SMs   = 0;
+
 /* # searches initiated in auxmap_L1, and # base cmps required */
 static ULong n_auxmap_L1_searches  = 0;
 static ULong n_auxmap_L1_cmps      = 0;
@@ -341,6 +348,8 @@ static ULong n_auxmap_L1_cmps      = 0;
    be handed to auxmap_L2. And the number of nodes inserted. */
 static ULong n_auxmap_L2_searches  = 0;
 static ULong n_auxmap_L2_nodes     = 0;
+/* # of auxmap_L2 index slots inspected by those searches */
+static ULong n_auxmap_L2_probes    = 0;
 
 static Int   n_sanity_cheap     = 0;
 static Int   n_sanity_expensive = 0;
@@ -405,6 +414,76 @@ static struct {
 
 static OSet* auxmap_L2 = NULL;
 
+/* auxmap_L2 owns the AuxMapEnts, but searching it means walking an
+   AVL tree whose depth grows with the amount of memory mapped above
+   MAX_PRIMARY_ADDRESS.  So that an L1 miss costs the same wherever the
+   client maps memory, L1 misses are instead resolved using this index:
+   an open-addressing hash table, with linear probing, of pointers to
+   the auxmap_L2 nodes, keyed by .base.  AuxMapEnts are never removed
+   from auxmap_L2, so the index never has to handle deletions.  It is
+   kept at most half full, so that probe sequences stay short. */
+#define AUXMAP_L2_INDEX_INIT_BITS 10
+
+static AuxMapEnt** auxmap_L2_index      = NULL;
+static UInt        auxmap_L2_index_bits = 0; /* index has 1 << this slots */
+
+static INLINE UWord auxmap_L2_index_hash ( Addr base )
+{
+   /* Fibonacci hashing of the 64k-chunk number: the top bits of the
+      product depend on all of the bits of the chunk number. */
+   ULong h = (ULong)(base >> 16) * 0x9E3779B97F4A7C15ULL;
+   return (UWord)(h >> (64 - auxmap_L2_index_bits));
+}
+
+static void auxmap_L2_index_insert ( AuxMapEnt* ent )
+{
+   UWord mask = (1UL << auxmap_L2_index_bits) - 1;
+   UWord ix   = auxmap_L2_index_hash(ent->base);
+   while (auxmap_L2_index[ix] != NULL)
+      ix = (ix + 1) & mask;
+   auxmap_L2_index[ix] = ent;
+}
+
+static void auxmap_L2_index_alloc ( UInt bits )
+{
+   SizeT szB = sizeof(AuxMapEnt*) << bits;
+   auxmap_L2_index_bits = bits;
+   auxmap_L2_index      = VG_(malloc)( "mc.auxmap_L2_index.1", szB );
+   VG_(memset)( auxmap_L2_index, 0, szB );
+}
+
+/* Add ent, which has just been inserted into auxmap_L2, to the
+   index, doubling the index's size first if that is needed to keep
+   it at most half full. */
+static void auxmap_L2_index_add ( AuxMapEnt* ent )
+{
+   if (2 * VG_(OSetGen_Size)(auxmap_L2) > (1UL << auxmap_L2_index_bits)) {
+      AuxMapEnt** old      = auxmap_L2_index;
+      UWord       old_size = 1UL << auxmap_L2_index_bits;
+      UWord       i;
+      auxmap_L2_index_alloc( auxmap_L2_index_bits + 1 );
+      for (i = 0; i < old_size; i++)
+         if (old[i] != NULL)
+            auxmap_L2_index_insert( old[i] );
+      VG_(free)( old );
+   }
+   auxmap_L2_index_insert( ent );
+}
+
+static INLINE AuxMapEnt* auxmap_L2_index_lookup ( Addr base )
+{
+   UWord      mask = (1UL << auxmap_L2_index_bits) - 1;
+   UWord      ix   = auxmap_L2_index_hash(base);
+   AuxMapEnt* ent;
+   while (True) {
+      n_auxmap_L2_probes++;
+      ent = auxmap_L2_index[ix];
+      if (ent == NULL || ent->base == base)
+         return ent;
+      ix = (ix + 1) & mask;
+   }
+}
+
 static void init_auxmap_L1_L2 ( void )
 {
    Int i;
@@ -418,6 +497,10 @@ static void init_auxmap_L1_L2 ( void )
    auxmap_L2 = VG_(OSetGen_Create)( /*keyOff*/  offsetof(AuxMapEnt,base),
                                     /*fastCmp*/ NULL,
                                     VG_(malloc), "mc.iaLL.1", VG_(free) );
+   /* On a 32-bit platform the auxmap is never used, so don't waste
+      space on an index for it. */
+   if (sizeof(void*) == 8)
+      auxmap_L2_index_alloc( AUXMAP_L2_INDEX_INIT_BITS );
 }
 
 /* Check representation invariants; if OK return NULL; else a
@@ -448,6 +531,8 @@ static const HChar* check_auxmap_L1_L2_sanity ( Word* n_secmaps_found )
       /* 32-bit platform */
       if (VG_(OSetGen_Size)(auxmap_L2) != 0)
          return "32-bit: auxmap_L2 is non-empty";
+      if (auxmap_L2_index != NULL)
+         return "32-bit: auxmap_L2_index exists";
       for (i = 0; i < N_AUXMAP_L1; i++) 
         if (auxmap_L1[i].base != 0 || auxmap_L1[i].ent != NULL)
       return "32-bit: auxmap_L1 is non-empty";
@@ -468,9 +553,26 @@ static const HChar* check_auxmap_L1_L2_sanity ( Word* n_secmaps_found )
             return "64-bit: .sm in _L2 is NULL";
          if (!is_distinguished_sm(elem->sm))
             (*n_secmaps_found)++;
+         if (auxmap_L2_index_lookup(elem->base) != elem)
+            return "64-bit: _L2 elem not found in _L2 index";
       }
       if (elems_seen != n_auxmap_L2_nodes)
          return "64-bit: disagreement on number of elems in _L2";
+      /* Check the index refers only to _L2 elems; together with the
+         check above, this means it refers to each of them once. */
+      elems_seen = 0;
+      for (i = 0; i < (1L << auxmap_L2_index_bits); i++) {
+         if (auxmap_L2_index[i] == NULL)
+            continue;
+         elems_seen++;
+         if (VG_(OSetGen_Lookup)(auxmap_L2, auxmap_L2_index[i])
+             != auxmap_L2_index[i])
+            return "64-bit: _L2 index entry not in _L2";
+      }
+      if (elems_seen != n_auxmap_L2_nodes)
+         return "64-bit: disagreement on number of elems in _L2 index";
+      if (2 * elems_seen > (1UL << auxmap_L2_index_bits))
+         return "64-bit: _L2 index is more than half full";
       /* Check L1-L2 correspondence */
       for (i = 0; i < N_AUXMAP_L1; i++) {
          if (auxmap_L1[i].base == 0 && auxmap_L1[i].ent == NULL)
@@ -520,7 +622,6 @@ static void insert_into_auxmap_L1_at ( Word rank, AuxMapEnt* ent )
 
 static INLINE AuxMapEnt* maybe_find_in_auxmap ( Addr a )
 {
-   AuxMapEnt  key;
    AuxMapEnt* res;
    Word       i;
 
@@ -569,10 +670,7 @@ static INLINE AuxMapEnt* maybe_find_in_auxmap ( Addr a )
    n_auxmap_L2_searches++;
 
    /* First see if we already have it. */
-   key.base = a;
-   key.sm   = 0;
-
-   res = VG_(OSetGen_Lookup)(auxmap_L2, &key);
+   res = auxmap_L2_index_lookup(a);
    if (res)
       insert_into_auxmap_L1_at( AUXMAP_L1_INSERT_IX, res );
    return res;
@@ -595,6 +693,7 @@ static AuxMapEnt* find_or_alloc_in_auxmap ( Addr a )
    nyu->base = a;
    nyu->sm   = &sm_distinguished[SM_DIST_NOACCESS];
    VG_(OSetGen_Insert)( auxmap_L2, nyu );
+   auxmap_L2_index_add( nyu );
    insert_into_auxmap_L1_at( AUXMAP_L1_INSERT_IX, nyu );
    n_auxmap_L2_nodes++;
    return nyu;
@@ -677,6 +776,14 @@ static INLINE SecMap* get_secmap_for_reading ( Addr a )
    to be able to write it.  If it is a distinguished secondary, make a
    writable copy of it, install it, and return the copy instead.  (COW
    semantics).
+
+   Making the copy may run the secondary map GC (see gcSecMaps), which
+   frees any other secondary that has become uniform.  So no caller
+   may hold a SecMap* from an earlier lookup across a call to this (or
+   to anything else which can call copy_for_writing): it must look the
+   secondary up again afterwards.  Code which needs to hold one should
+   note n_SM_GCs first and assert that it hasn't changed, as
+   MC_(copy_address_range_state) does.
 */
 static INLINE SecMap* get_secmap_for_writing ( Addr a )
 {
@@ -699,6 +806,128 @@ static SecMap* maybe_get_secmap_for ( Addr a )
    }
 }
 
+/* --------------- Secondary map reclamation --------------- */
+
+/* A non-distinguished secondary can end up holding the same V+A bits
+   for every byte, for example when a big block is freed piecemeal, or
+   a buffer is entirely written.  It is then a waste of memory, since
+   the matching distinguished secondary would do just as well.
+   set_address_range_perms only notices this for ranges covering whole
+   secondaries, so we periodically look for such secondaries, point
+   the primary map at the distinguished one instead, and free them.
+
+   The GC is done from copy_for_writing when the number of
+   non-distinguished secondaries reaches secMapGCLimit.  That is then
+   set to twice the number of survivors, so the cost of a GC is
+   amortised over at least as many secondary allocations as were
+   scanned.
+
+   A secondary is only reclaimed if it was also uniform at the
+   previous GC.  Memory which is freed and soon reused, as happens all
+   the time in the heap, would otherwise have its secondary reclaimed
+   and then copied again straight away.  uniform_SM_bases holds the
+   base addresses of the secondaries found uniform by the last GC.
+
+   This is safe because no code holds a SecMap* across a call which
+   might allocate another secondary (see get_secmap_for_writing); the
+   caller of copy_for_writing only looks at the map it is replacing,
+   which is distinguished and so not touched here.
+
+   --reclaim-shadow-memory=no turns the GC off. */
+
+#define SM_GC_MIN_LIMIT  1024
+
+static Int   secMapGCLimit    = SM_GC_MIN_LIMIT;
+static OSet* uniform_SM_bases = NULL;
+
+/* If every byte of 'sm' has the same V+A bits, so that it could be
+   replaced by a distinguished secondary, return the index of that
+   secondary, else -1. */
+static Int uniform_SM_kind ( const SecMap* sm )
+{
+   UWord  i;
+   UShort vabits16 = sm->vabits16[0];
+
+   if (vabits16 != VA_BITS16_NOACCESS
+       && vabits16 != VA_BITS16_UNDEFINED
+       && vabits16 != VA_BITS16_DEFINED)
+      return -1;
+   for (i = 1; i < SM_CHUNKS/2; i++) {
+      if (sm->vabits16[i] != vabits16)
+         return -1;
+   }
+   switch (vabits16) {
+      case VA_BITS16_NOACCESS:  return SM_DIST_NOACCESS;
+      case VA_BITS16_UNDEFINED: return SM_DIST_UNDEFINED;
+      default:                  return SM_DIST_DEFINED;
+   }
+}
+
+/* Returns the replacement for 'sm', the secondary for the range
+   starting at 'base', freeing it if need be.  If it is uniform but
+   wasn't at the last GC, it is kept, and its base noted in
+   'now_uniform' instead. */
+static SecMap* gc_one_SM ( SecMap* sm, Addr base, OSet* now_uniform )
+{
+   Int    kind;
+   SysRes sres;
+
+   if (is_distinguished_sm(sm))
+      return sm;
+   kind = uniform_SM_kind(sm);
+   if (kind == -1)
+      return sm;
+   if (!VG_(OSetWord_Contains)(uniform_SM_bases, base)) {
+      VG_(OSetWord_Insert)(now_uniform, base);
+      return sm;
+   }
+   sres = VG_(am_munmap_valgrind)((Addr)sm, sizeof(SecMap));
+   tl_assert2(! sr_isError(sres), "SecMap valgrind munmap failure\n");
+   update_SM_counts(sm, &sm_distinguished[kind]);
+   n_reclaimed_SMs++;
+   return &sm_distinguished[kind];
+}
+
+static void gcSecMaps ( void )
+{
+   AuxMapEnt* elem;
+   UWord      i;
+   Int        n_before = n_non_DSM_SMs;
+   OSet*      now_uniform;
+
+   n_SM_GCs++;
+   if (uniform_SM_bases == NULL)
+      uniform_SM_bases = VG_(OSetWord_Create)( VG_(malloc), "mc.gcSM.1",
+                                               VG_(free) );
+   now_uniform = VG_(OSetWord_Create)( VG_(malloc), "mc.gcSM.2", VG_(free) );
+   for (i = 0; i < N_PRIMARY_MAP; i++)
+      primary_map[i] = gc_one_SM(primary_map[i], i * SM_SIZE, now_uniform);
+   VG_(OSetGen_ResetIter)(auxmap_L2);
+   while ( (elem = VG_(OSetGen_Next)(auxmap_L2)) )
+      elem->sm = gc_one_SM(elem->sm, elem->base, now_uniform);
+   VG_(OSetWord_Destroy)(uniform_SM_bases);
+   uniform_SM_bases = now_uniform;
+
+   secMapGCLimit = 2 * n_non_DSM_SMs;
+   if (secMapGCLimit < SM_GC_MIN_LIMIT)
+      secMapGCLimit = SM_GC_MIN_LIMIT;
+
+   if (VG_(clo_verbosity) > 1) {
+      VG_(message)(Vg_DebugMsg,
+                   "memcheck GC: %d secondaries, %d reclaimed, "
+                   "next GC at %d\n",
+                   n_before, n_before - n_non_DSM_SMs, secMapGCLimit);
+   }
+}
+
+static void maybe_gcSecMaps ( void )
+{
+   if (UNLIKELY(n_non_DSM_SMs >= secMapGCLimit)
+       && MC_(clo_reclaim_shadow_memory))
+      gcSecMaps();
+}
+
+
 /* --------------- Fundamental functions --------------- */
 
 static INLINE
@@ -792,9 +1021,10 @@ static void  set_sec_vbits8(Addr a, UWord vbits8);
 static INLINE
 Bool set_vbits8 ( Addr a, UChar vbits8 )
 {
-   Bool  ok      = True;
-   UChar vabits2 = get_vabits2(a);
-   if ( VA_BITS2_NOACCESS != vabits2 ) {
+   Bool  ok          = True;
+   UChar old_vabits2 = get_vabits2(a);
+   UChar vabits2;
+   if ( VA_BITS2_NOACCESS != old_vabits2 ) {
       // Addressable.  Convert in-register format to in-memory format.
       // Also remove any existing sec V bit entry for the byte if no
       // longer necessary.
@@ -802,7 +1032,10 @@ Bool set_vbits8 ( Addr a, UChar vbits8 )
       else if ( V_BITS8_UNDEFINED == vbits8 ) { vabits2 = VA_BITS2_UNDEFINED; }
       else                                    { vabits2 = VA_BITS2_PARTDEFINED;
                                                 set_sec_vbits8(a, vbits8);  }
-      set_vabits2(a, vabits2);
+      // Don't write if nothing changes: the secondary may be a
+      // distinguished one, which would then be copied for no reason.
+      if (vabits2 != old_vabits2)
+         set_vabits2(a, vabits2);
 
    } else {
       // Unaddressable!  Do nothing -- when writing to unaddressable
@@ -1963,29 +2196,55 @@ void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
 
    if (nooverlap && aligned) {
 
-      /* Vectorised fast case, when no overlap and suitably aligned */
-      /* vector loop */
+      /* Vectorised fast case, when no overlap and suitably aligned.
+         Copy a piece at a time, each piece lying within a single
+         secondary map of both src and dst, so that the secondaries
+         need only be looked up once per piece. */
       i = 0;
       while (len >= 4) {
-         vabits8 = get_vabits8_for_aligned_word32( src+i );
-         set_vabits8_for_aligned_word32( dst+i, vabits8 );
-         if (LIKELY(VA_BITS8_DEFINED == vabits8 
-                            || VA_BITS8_UNDEFINED == vabits8 
-                            || VA_BITS8_NOACCESS == vabits8)) {
-            /* do nothing */
+         SecMap* src_sm = get_secmap_for_reading( src+i );
+         SizeT   n      = len;
+         if (n > SM_SIZE - ((src+i) & (SM_SIZE-1)))
+            n = SM_SIZE - ((src+i) & (SM_SIZE-1));
+         if (n > SM_SIZE - ((dst+i) & (SM_SIZE-1)))
+            n = SM_SIZE - ((dst+i) & (SM_SIZE-1));
+         n &= ~(SizeT)3;
+
+         if (is_distinguished_sm(src_sm)) {
+            /* The whole piece is in the same state and has no
+               secondary V bits.  Setting rather than copying it lets
+               whole secondaries of dst become distinguished ones. */
+            UWord dsm_num = src_sm - &sm_distinguished[0];
+            set_address_range_perms( dst+i, n, src_sm->vabits16[0], dsm_num );
          } else {
-            /* have to copy secondary map info */
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+0 ))
-               set_sec_vbits8( dst+i+0, get_sec_vbits8( src+i+0 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+1 ))
-               set_sec_vbits8( dst+i+1, get_sec_vbits8( src+i+1 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+2 ))
-               set_sec_vbits8( dst+i+2, get_sec_vbits8( src+i+2 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+3 ))
-               set_sec_vbits8( dst+i+3, get_sec_vbits8( src+i+3 ) );
+            /* Get dst's secondary first: making it writable may cause
+               src's to be reclaimed, if it has become uniform. */
+            SecMap* dst_sm  = get_secmap_for_writing( dst+i );
+            UWord   src_off = SM_OFF(src+i);
+            UWord   k;
+            Int     gcs     = n_SM_GCs;
+            src_sm = get_secmap_for_reading( src+i );
+            VG_(memcpy)( &dst_sm->vabits8[SM_OFF(dst+i)],
+                         &src_sm->vabits8[src_off], n / 4 );
+            for (k = 0; k < n; k += 4) {
+               vabits8 = src_sm->vabits8[src_off + k / 4];
+               if (LIKELY(VA_BITS8_DEFINED == vabits8 
+                                  || VA_BITS8_UNDEFINED == vabits8 
+                                  || VA_BITS8_NOACCESS == vabits8)) {
+                  /* do nothing */
+               } else {
+                  /* have to copy secondary map info */
+                  for (j = k; j < k + 4; j++) {
+                     if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+j ))
+                        set_sec_vbits8( dst+i+j, get_sec_vbits8( src+i+j ) );
+                  }
+               }
+            }
+            /* src_sm and dst_sm were held throughout. */
+            tl_assert(n_SM_GCs == gcs);
          }
-         i += 4;
-         len -= 4;
+         i += n;
+         len -= n;
       }
       /* fixup loop */
       while (len >= 1) {
@@ -4059,6 +4318,66 @@ typedef
    MC_ReadResult;
 
 
+/* Returns the length of a prefix of [a .. a+len) all of whose bytes
+   are in the state that vabits8 gives for 4 bytes (one of
+   VA_BITS8_{NOACCESS,UNDEFINED,DEFINED}).  It is not necessarily the
+   longest such prefix: a is only examined if it is 4-aligned, and the
+   result is a multiple of 4.  It is found a secondary map at a time,
+   skipping over distinguished secondaries in one step and scanning
+   others 32 bytes at a time, which is much cheaper than calling
+   get_vabits2 for each byte.  The checkers below use it to get
+   quickly over the parts of a range that are in the state they want,
+   and handle the rest byte by byte. */
+static SizeT uniform_prefix_len ( Addr a, SizeT len, UChar vabits8 )
+{
+   const SecMap* dsm;
+   const ULong   vabits64 = (ULong)vabits8 * 0x0101010101010101ULL;
+   SizeT         done     = 0;
+
+   switch (vabits8) {
+      case VA_BITS8_NOACCESS:  dsm = &sm_distinguished[SM_DIST_NOACCESS];  break;
+      case VA_BITS8_UNDEFINED: dsm = &sm_distinguished[SM_DIST_UNDEFINED]; break;
+      case VA_BITS8_DEFINED:   dsm = &sm_distinguished[SM_DIST_DEFINED];   break;
+      default: tl_assert(0);
+   }
+
+   if (!VG_IS_4_ALIGNED(a))
+      return 0;
+
+   while (len - done >= 4) {
+      Addr    p     = a + done;
+      SecMap* sm    = get_secmap_for_reading(p);
+      SizeT   chunk = SM_SIZE - (p & (SM_SIZE-1));
+      UWord   off0, off, lim;
+
+      if (chunk > len - done)
+         chunk = len - done;
+      if (sm == dsm) {
+         done += chunk & ~(SizeT)3;
+         continue;
+      }
+      if (is_distinguished_sm(sm))
+         break;
+
+      off0 = off = SM_OFF(p);
+      lim  = off + chunk / 4;
+      while (off < lim) {
+         if (VG_IS_8_ALIGNED(off) && off + 8 <= lim
+             && *(ULong*)(&sm->vabits8[off]) == vabits64) {
+            off += 8;
+            continue;
+         }
+         if (sm->vabits8[off] != vabits8)
+            break;
+         off++;
+      }
+      done += (off - off0) * 4;
+      if (off < lim)
+         break;
+   }
+   return done;
+}
+
 /* Check permissions for address range.  If inadequate permissions
    exist, *bad_addr is set to the offending address, so the caller can
    know what it is. */
@@ -4074,6 +4393,12 @@ Bool MC_(check_mem_is_noaccess) ( Addr a, SizeT len, Addr* bad_addr )
 
    PROF_EVENT(MCPE_CHECK_MEM_IS_NOACCESS);
    for (i = 0; i < len; i++) {
+      SizeT n = uniform_prefix_len(a, len - i, VA_BITS8_NOACCESS);
+      if (n > 0) {
+         a += n;
+         i += n - 1;
+         continue;
+      }
       PROF_EVENT(MCPE_CHECK_MEM_IS_NOACCESS_LOOP);
       vabits2 = get_vabits2(a);
       if (VA_BITS2_NOACCESS != vabits2) {
@@ -4093,6 +4418,13 @@ static Bool is_mem_addressable ( Addr a, SizeT len,
 
    PROF_EVENT(MCPE_IS_MEM_ADDRESSABLE);
    for (i = 0; i < len; i++) {
+      /* Defined memory is certainly addressable. */
+      SizeT n = uniform_prefix_len(a, len - i, VA_BITS8_DEFINED);
+      if (n > 0) {
+         a += n;
+         i += n - 1;
+         continue;
+      }
       PROF_EVENT(MCPE_IS_MEM_ADDRESSABLE_LOOP);
       vabits2 = get_vabits2(a);
       if (VA_BITS2_NOACCESS == vabits2) {
@@ -4117,6 +4449,12 @@ static MC_ReadResult is_mem_defined ( Addr a, SizeT len,
    if (otag)     *otag = 0;
    if (bad_addr) *bad_addr = 0;
    for (i = 0; i < len; i++) {
+      SizeT n = uniform_prefix_len(a, len - i, VA_BITS8_DEFINED);
+      if (n > 0) {
+         a += n;
+         i += n - 1;
+         continue;
+      }
       PROF_EVENT(MCPE_IS_MEM_DEFINED_LOOP);
       vabits2 = get_vabits2(a);
       if (VA_BITS2_DEFINED != vabits2) {
@@ -4170,6 +4508,12 @@ static void is_mem_defined_comprehensive (
    tl_assert(!(*errorV || *errorA));
 
    for (i = 0; i < len; i++) {
+      SizeT n = uniform_prefix_len(a, len - i, VA_BITS8_DEFINED);
+      if (n > 0) {
+         a += n;
+         i += n - 1;
+         continue;
+      }
       PROF_EVENT(MCPE_IS_MEM_DEFINED_COMPREHENSIVE_LOOP);
       vabits2 = get_vabits2(a);
       switch (vabits2) {
@@ -4679,6 +5023,21 @@ STATIC_ASSERT(V_BITS8_UNDEFINED == 0xFF);
 #define UNALIGNED_OR_HIGH(_a,_szInBits) \
    ((_a) & MASK((_szInBits>>3)))
 
+/* On some hosts, the instrumenter generates the all-defined case of
+   STOREV64/32 inline (see gen_inline_STOREV_test in mc_translate.c),
+   and so needs to know where the primary map is and how many entries
+   it has.  Without the fast paths in the helpers, there shouldn't be
+   any inline either. */
+void* MC_(get_primary_map) ( /*OUT*/UWord* n_entries )
+{
+   *n_entries = N_PRIMARY_MAP;
+#  if defined(PERF_FAST_LOADV) && defined(PERF_FAST_STOREV)
+   return primary_map;
+#  else
+   return NULL;
+#  endif
+}
+
 /* On a 32-bit machine:
 
    N_PRIMARY_BITS          == 16, so
@@ -5829,6 +6188,16 @@ Bool MC_(is_within_valid_secondary) ( Addr a )
 }
 
 
+/* For the memory leak detector, say whether an entire 64k chunk of
+   address space is known to be defined, in which case its words need
+   not be checked one at a time.  If in doubt return False.
+*/
+Bool MC_(is_within_defined_secondary) ( Addr a )
+{
+   return maybe_get_secmap_for ( a ) == &sm_distinguished[SM_DIST_DEFINED];
+}
+
+
 /* For the memory leak detector, say whether or not a given word
    address is to be regarded as valid. */
 Bool MC_(is_valid_aligned_word) ( Addr a )
@@ -6024,6 +6393,7 @@ KeepStacktraces MC_(clo_keep_stacktraces)     = KS_alloc_and_free;
 Int           MC_(clo_mc_level)               = 2;
 Bool          MC_(clo_show_mismatched_frees)  = True;
 Bool          MC_(clo_expensive_definedness_checks) = False;
+Bool          MC_(clo_reclaim_shadow_memory)  = True;
 Bool          MC_(clo_ignore_range_below_sp)               = False;
 UInt          MC_(clo_ignore_range_below_sp__first_offset) = 0;
 UInt          MC_(clo_ignore_range_below_sp__last_offset)  = 0;
@@ -6217,6 +6587,8 @@ static Bool mc_process_cmd_line_options(const HChar* arg)
                        MC_(clo_show_mismatched_frees)) {}
    else if VG_BOOL_CLO(arg, "--expensive-definedness-checks",
                        MC_(clo_expensive_definedness_checks)) {}
+   else if VG_BOOL_CLO(arg, "--reclaim-shadow-memory",
+                       MC_(clo_reclaim_shadow_memory)) {}
 
    else if VG_BOOL_CLO(arg, "--xtree-leak",
                        MC_(clo_xtree_leak)) {}
@@ -6273,6 +6645,8 @@ static void mc_print_usage(void)
 "    --keep-stacktraces=alloc|free|alloc-and-free|alloc-then-free|none\n"
 "        stack trace(s) to keep for malloc'd/free'd areas       [alloc-and-free]\n"
 "    --show-mismatched-frees=no|yes   show frees that don't match the allocator? [yes]\n"
+"    --reclaim-shadow-memory=no|yes   free shadow memory for ranges that\n"
+"                                     have returned to a uniform state [yes]\n"
    );
 }
 
@@ -6920,6 +7294,113 @@ static Bool handle_gdb_monitor_command (ThreadId tid, HChar *req)
 /*--- Client requests                                      ---*/
 /*------------------------------------------------------------*/
 
+/* Copy the origin tags of [src, src+len) to [dst, dst+len), which may
+   overlap, a 32-bit group at a time where the alignment allows. */
+static void copy_address_range_otags ( Addr src, Addr dst, SizeT len )
+{
+   SizeT i;
+   Bool  groups = ((src ^ dst) & 3) == 0;
+
+   if (dst <= src) {
+      i = 0;
+      while (i < len) {
+         if (groups && VG_IS_4_ALIGNED(src+i) && len - i >= 4) {
+            MC_(helperc_b_store4)( dst+i, MC_(helperc_b_load4)( src+i ) );
+            i += 4;
+         } else {
+            MC_(helperc_b_store1)( dst+i, MC_(helperc_b_load1)( src+i ) );
+            i += 1;
+         }
+      }
+   } else {
+      i = len;
+      while (i > 0) {
+         if (groups && VG_IS_4_ALIGNED(src+i) && i >= 4) {
+            i -= 4;
+            MC_(helperc_b_store4)( dst+i, MC_(helperc_b_load4)( src+i ) );
+         } else {
+            i -= 1;
+            MC_(helperc_b_store1)( dst+i, MC_(helperc_b_load1)( src+i ) );
+         }
+      }
+   }
+}
+
+/* Is [a, a+len) entirely in anonymous client mappings with the
+   permissions in 'prot'?  Only such memory can safely be accessed
+   directly by the host: a file mapping may extend past the end of its
+   file, and touching that part raises SIGBUS, which would kill
+   Valgrind rather than be delivered to the client. */
+static Bool is_anon_client_mem ( Addr a, SizeT len, UInt prot )
+{
+   while (len > 0) {
+      NSegment const* seg = VG_(am_find_nsegment)( a );
+      SizeT n;
+      if (seg == NULL || seg->kind != SkAnonC
+          || ((prot & VKI_PROT_READ)  && !seg->hasR)
+          || ((prot & VKI_PROT_WRITE) && !seg->hasW))
+         return False;
+      n = seg->end - a + 1;
+      if (n > len)
+         n = len;
+      a   += n;
+      len -= n;
+   }
+   return True;
+}
+
+/* Can the client's memcpy or memset write [dst, dst+len), and, if
+   src is not 0, read [src, src+len), without any error being
+   reported?  The host must be able to as well, since bulk_copy and
+   bulk_fill access the memory directly; so anything other than
+   anonymous memory is left to the replacement's loop, where a fault
+   is the client's. */
+static Bool bulk_ok ( Addr dst, Addr src, SizeT len )
+{
+   Addr bad_addr;
+   if (!is_mem_addressable( dst, len, &bad_addr )
+       || !is_anon_client_mem( dst, len, VKI_PROT_WRITE ))
+      return False;
+   if (src != 0
+       && (!is_mem_addressable( src, len, &bad_addr )
+           || !is_anon_client_mem( src, len, VKI_PROT_READ )))
+      return False;
+   return True;
+}
+
+/* _VG_USERREQ__MEMCHECK_BULK_COPY, from the replacement memcpy and
+   friends: copy len bytes from src to dst, taking their V bits and
+   origins with them, just as the replacement's loop would have done.
+   If that would produce errors, return False and leave it to the loop,
+   so that they are reported exactly as before. */
+static Bool bulk_copy ( Addr dst, Addr src, SizeT len )
+{
+   if (len == 0 || !bulk_ok( dst, src, len ))
+      return False;
+   if (src+len <= dst || dst+len <= src)
+      VG_(memcpy)( (void*)dst, (void*)src, len );
+   else
+      VG_(memmove)( (void*)dst, (void*)src, len );
+   MC_(copy_address_range_state)( src, dst, len );
+   if (MC_(clo_mc_level) == 3)
+      copy_address_range_otags( src, dst, len );
+   return True;
+}
+
+/* _VG_USERREQ__MEMCHECK_BULK_FILL, from the replacement memset: set
+   len bytes at dst to copies of the byte at cp.  Only done if that
+   byte is defined, which is the case that matters; an undefined
+   byte's V bits and origin are left for the loop to propagate. */
+static Bool bulk_fill ( Addr dst, Addr cp, SizeT len )
+{
+   if (len == 0 || get_vabits2( cp ) != VA_BITS2_DEFINED
+       || !bulk_ok( dst, 0, len ))
+      return False;
+   VG_(memset)( (void*)dst, *(UChar*)cp, len );
+   MC_(make_mem_defined)( dst, len );
+   return True;
+}
+
 static Bool mc_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
 {
    Int   i;
@@ -7153,6 +7634,14 @@ static Bool mc_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
          return True;
       }
 
+      case _VG_USERREQ__MEMCHECK_BULK_COPY:
+         *ret = bulk_copy( (Addr)arg[1], (Addr)arg[2], (SizeT)arg[3] );
+         return True;
+
+      case _VG_USERREQ__MEMCHECK_BULK_FILL:
+         *ret = bulk_fill( (Addr)arg[1], (Addr)arg[2], (SizeT)arg[3] );
+         return True;
+
       case VG_USERREQ__CREATE_MEMPOOL: {
          Addr pool      = (Addr)arg[1];
          UInt rzB       =       arg[2];
@@ -7949,15 +8438,58 @@ static void print_SM_info(const HChar* type, Int n_SMs)
       n_SMs * sizeof(SecMap) / (1024 * 1024UL) );
 }
 
+/* A non-distinguished secondary in which at most this many of the
+   4-byte chunks are other than fully defined counts as "nearly
+   defined" in the stats below.  Such secondaries are the ones which
+   would benefit most from a more compact representation. */
+#define SM_NEARLY_DEFINED_MAX_EXCEPTIONS  (SM_CHUNKS / 64)
+
+static void count_SM_kind ( const SecMap* sm,
+                            /*MOD*/Int* n_uniform, /*MOD*/Int* n_nearly_def )
+{
+   UWord i, n_exceptions = 0;
+
+   if (uniform_SM_kind(sm) != -1) {
+      (*n_uniform)++;
+      return;
+   }
+   for (i = 0; i < SM_CHUNKS; i++) {
+      if (sm->vabits8[i] != VA_BITS8_DEFINED)
+         n_exceptions++;
+   }
+   if (n_exceptions <= SM_NEARLY_DEFINED_MAX_EXCEPTIONS)
+      (*n_nearly_def)++;
+}
+
+/* Classify the non-distinguished secondaries currently in use. */
+static void count_SM_kinds ( /*OUT*/Int* n_uniform, /*OUT*/Int* n_nearly_def )
+{
+   AuxMapEnt* elem;
+   UWord      i;
+
+   *n_uniform = *n_nearly_def = 0;
+   for (i = 0; i < N_PRIMARY_MAP; i++) {
+      if (!is_distinguished_sm(primary_map[i]))
+         count_SM_kind(primary_map[i], n_uniform, n_nearly_def);
+   }
+   VG_(OSetGen_ResetIter)(auxmap_L2);
+   while ( (elem = VG_(OSetGen_Next)(auxmap_L2)) ) {
+      if (!is_distinguished_sm(elem->sm))
+         count_SM_kind(elem->sm, n_uniform, n_nearly_def);
+   }
+}
+
 static void mc_print_stats (void)
 {
    SizeT max_secVBit_szB, max_SMs_szB, max_shmem_szB;
+   Int   n_uniform_SMs, n_nearly_def_SMs;
 
    VG_(message)(Vg_DebugMsg, " memcheck: freelist: vol %lld length %lld\n",
                 VG_(free_queue_volume), VG_(free_queue_length));
    VG_(message)(Vg_DebugMsg,
       " memcheck: sanity checks: %d cheap, %d expensive\n",
       n_sanity_cheap, n_sanity_expensive );
+   MC_(print_tidy_stats)();
    VG_(message)(Vg_DebugMsg,
       " memcheck: auxmaps: %llu auxmap entries (%lluk, %lluM) in use\n",
       n_auxmap_L2_nodes, 
@@ -7970,8 +8502,10 @@ static void mc_print_stats (void)
          / (n_auxmap_L1_searches ? n_auxmap_L1_searches : 1) 
    );   
    VG_(message)(Vg_DebugMsg,
-      " memcheck: auxmaps_L2: %llu searches, %llu nodes\n",
-      n_auxmap_L2_searches, n_auxmap_L2_nodes
+      " memcheck: auxmaps_L2: %llu searches, %llu probes, %llu nodes"
+      " (index size %lu)\n",
+      n_auxmap_L2_searches, n_auxmap_L2_probes, n_auxmap_L2_nodes,
+      auxmap_L2_index ? 1UL << auxmap_L2_index_bits : 0UL
    );   
 
    print_SM_info("n_issued     ", n_issued_SMs);
@@ -7980,6 +8514,13 @@ static void mc_print_stats (void)
    print_SM_info("max_undefined", max_undefined_SMs);
    print_SM_info("max_defined  ", max_defined_SMs);
    print_SM_info("max_non_DSM  ", max_non_DSM_SMs);
+   print_SM_info("n_reclaimed  ", n_reclaimed_SMs);
+   VG_(message)(Vg_DebugMsg,
+      " memcheck: SMs: %d reclamation GCs\n", n_SM_GCs);
+   count_SM_kinds(&n_uniform_SMs, &n_nearly_def_SMs);
+   print_SM_info("non_DSM      ", n_non_DSM_SMs);
+   print_SM_info("  uniform    ", n_uniform_SMs);
+   print_SM_info("  nearly_def ", n_nearly_def_SMs);
 
    // Three DSMs, plus the non-DSM ones
    max_SMs_szB = (3 + max_non_DSM_SMs) * sizeof(SecMap);
@@ -8168,6 +8709,7 @@ static void mc_pre_clo_init(void)
                                    mc_fini);
 
    VG_(needs_final_IR_tidy_pass)  ( MC_(final_tidy) );
+   VG_(needs_uninstrumented_objects) ( MC_(instrument_uninstrumented) );
 
 
    VG_(needs_core_errors)         ();
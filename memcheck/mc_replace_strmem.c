@@ -45,4 +45,21 @@
                   _VG_USERREQ__MEMCHECK_RECORD_OVERLAP_ERROR,   \
                   s, src, dst, len, 0)
 
+/* Memcheck does memcpys and memsets of at least BULK_MIN_LEN bytes
+   itself; see bulk_copy and bulk_fill in mc_main.c.  For shorter ones
+   the client request costs more than it saves. */
+#define BULK_MIN_LEN 512
+
+#define BULK_COPY(dst, src, len)                                \
+  ((len) >= BULK_MIN_LEN &&                                     \
+   VALGRIND_DO_CLIENT_REQUEST_EXPR(0,                           \
+                  _VG_USERREQ__MEMCHECK_BULK_COPY,              \
+                  dst, src, len, 0, 0))
+
+#define BULK_FILL(dst, cp, len)                                 \
+  ((len) >= BULK_MIN_LEN &&                                     \
+   VALGRIND_DO_CLIENT_REQUEST_EXPR(0,                           \
+                  _VG_USERREQ__MEMCHECK_BULK_FILL,              \
+                  dst, cp, len, 0, 0))
+
 #include "../shared/vg_replace_strmem.c"
@@ -39,6 +39,7 @@
 #include "pub_tool_xarray.h"
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_libcbase.h"
+#include "pub_tool_options.h"      // VG_(clo_stats)
 
 #include "mc_include.h"
 
@@ -216,6 +217,10 @@ typedef
          arguments of type 'HWord' to be passed to helper functions.
          Ity_I32 or Ity_I64 only. */
       IRType hWordTy;
+
+      /* READONLY: True if we are doing MC_(instrument_uninstrumented),
+         in which case no definedness checks are to be made. */
+      Bool uninstrumented;
    }
    MCEnv;
 
@@ -1289,8 +1294,9 @@ static void complainIfUndefined ( MCEnv* mce, IRAtom* atom, IRExpr *guard )
    IRExpr** args;
    Int      nargs;
 
-   // Don't do V bit tests if we're not reporting undefined value errors.
-   if (MC_(clo_mc_level) == 1)
+   // Don't do V bit tests if we're not reporting undefined value errors,
+   // or in code that isn't being checked at all.
+   if (MC_(clo_mc_level) == 1 || mce->uninstrumented)
       return;
 
    if (guard)
@@ -5160,6 +5166,91 @@ IRExpr* zwidenToHostWord ( MCEnv* mce, IRAtom* vatom )
 }
 
 
+/* On amd64 hosts, generate IR to test for the common case of a
+   STOREV64/32: a store that is naturally aligned, is covered by the
+   primary map, writes all-defined |vdata|, and is to memory that is
+   already all defined.  In that case the helper would do nothing (see
+   mc_STOREV64 et al in mc_main.c), so the caller need only call it
+   when the returned Ity_I1 atom is false.  Returns NULL if no such
+   test can be generated for this store.
+
+   The shadow memory loads are made even when the address is not
+   covered by the primary map: the primary map index is masked so
+   that they are always safe, and the loaded values don't matter in
+   that case.
+
+   The same could be done for LOADV64/32, but that doesn't pay: the
+   loaded V bits would have to be merged with the helper's result
+   after the call, and the register allocator has to assume that the
+   call happens, so the test result gets spilled around it. */
+static IRAtom* gen_inline_STOREV_test ( MCEnv* mce, IRType ty,
+                                        IRAtom* addr, IRAtom* vdata )
+{
+#  if defined(VGA_amd64)
+   UWord   n_pm;
+   void*   pm;
+   UInt    szB;
+   ULong   mask;
+   IRAtom *pmix, *smp, *sm, *vaoff, *vaddr, *vabits, *bad;
+
+   switch (ty) {
+      case Ity_I64: szB = 8; break;
+      case Ity_I32: szB = 4; break;
+      default:      return NULL;
+   }
+   pm = MC_(get_primary_map)( &n_pm );
+   if (pm == NULL)
+      return NULL;
+   tl_assert(mce->hWordTy == Ity_I64);
+   tl_assert(typeOfIRExpr(mce->sb->tyenv, addr) == Ity_I64);
+   tl_assert(typeOfIRExpr(mce->sb->tyenv, vdata) == ty);
+
+   /* Nonzero iff addr is misaligned or not covered by the primary
+      map.  Cf. MASK in mc_main.c. */
+   mask = ~((0x10000ULL - szB) | ((ULong)(n_pm - 1) << 16));
+
+   /* sm = primary_map[(addr >> 16) & (n_pm - 1)] */
+   pmix = assignNew('V', mce, Ity_I64, binop(Iop_Shr64, addr, mkU8(16)));
+   pmix = assignNew('V', mce, Ity_I64, binop(Iop_And64, pmix,
+                                             mkU64(n_pm - 1)));
+   smp  = assignNew('V', mce, Ity_I64, binop(Iop_Shl64, pmix, mkU8(3)));
+   smp  = assignNew('V', mce, Ity_I64, binop(Iop_Add64, smp,
+                                             mkU64((ULong)(HWord)pm)));
+   sm   = assignNew('V', mce, Ity_I64, IRExpr_Load(Iend_LE, Ity_I64, smp));
+
+   /* The vabits16 (for 8 bytes) or vabits8 (for 4 bytes) covering
+      addr, widened to 64 bits and xor'd with the all-defined value,
+      so that it is zero iff the memory is all defined (0xAAAA is
+      VA_BITS16_DEFINED, 0xAA is VA_BITS8_DEFINED). */
+   vaoff = assignNew('V', mce, Ity_I64,
+                     binop(Iop_And64, addr, mkU64(0x10000 - szB)));
+   vaoff = assignNew('V', mce, Ity_I64, binop(Iop_Shr64, vaoff, mkU8(2)));
+   vaddr = assignNew('V', mce, Ity_I64, binop(Iop_Add64, sm, vaoff));
+   if (szB == 8) {
+      vabits = assignNew('V', mce, Ity_I16,
+                         IRExpr_Load(Iend_LE, Ity_I16, vaddr));
+      vabits = assignNew('V', mce, Ity_I64, unop(Iop_16Uto64, vabits));
+      vabits = assignNew('V', mce, Ity_I64,
+                         binop(Iop_Xor64, vabits, mkU64(0xAAAA)));
+   } else {
+      vabits = assignNew('V', mce, Ity_I8,
+                         IRExpr_Load(Iend_LE, Ity_I8, vaddr));
+      vabits = assignNew('V', mce, Ity_I64, unop(Iop_8Uto64, vabits));
+      vabits = assignNew('V', mce, Ity_I64,
+                         binop(Iop_Xor64, vabits, mkU64(0xAA)));
+      vdata  = assignNew('V', mce, Ity_I64, unop(Iop_32Uto64, vdata));
+   }
+
+   bad = assignNew('V', mce, Ity_I64, binop(Iop_And64, addr, mkU64(mask)));
+   bad = assignNew('V', mce, Ity_I64, binop(Iop_Or64, bad, vabits));
+   bad = assignNew('V', mce, Ity_I64, binop(Iop_Or64, bad, vdata));
+   return assignNew('V', mce, Ity_I1, binop(Iop_CmpEQ64, bad, mkU64(0)));
+#  else
+   return NULL;
+#  endif
+}
+
+
 /* Generate a shadow store.  |addr| is always the original address
    atom.  You can pass in either originals or V-bits for the data
    atom, but obviously not both.  This function generates a check for
@@ -5386,7 +5477,7 @@ void do_shadow_Store ( MCEnv* mce,
    } else {
 
       IRDirty *di;
-      IRAtom  *addrAct;
+      IRAtom  *addrAct, *inlineOK;
 
       /* 8/16/32/64-bit cases */
       /* Generate the actual address into addrAct. */
@@ -5397,6 +5488,11 @@ void do_shadow_Store ( MCEnv* mce,
          addrAct = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBias));
       }
 
+      /* If possible, deal with the common case inline, and only call
+         the helper when that fails. */
+      inlineOK = guard ? NULL
+                       : gen_inline_STOREV_test( mce, ty, addrAct, vdata );
+
       if (ty == Ity_I64) {
          /* We can't do this with regparm 2 on 32-bit platforms, since
             the back ends aren't clever enough to handle 64-bit
@@ -5415,6 +5511,8 @@ void do_shadow_Store ( MCEnv* mce,
               );
       }
       if (guard) di->guard = guard;
+      if (inlineOK)
+         di->guard = assignNew('V', mce, Ity_I1, unop(Iop_Not1, inlineOK));
       setHelperAnns( mce, di );
       stmt( 'V', mce, IRStmt_Dirty(di) );
    }
@@ -6732,6 +6830,240 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Instrumentation for --uninstrumented-objects=        ---*/
+/*------------------------------------------------------------*/
+
+/* Code in objects named by --uninstrumented-objects= is trusted, so
+   nothing in it is checked and no V bits are computed for it.  But
+   whatever it writes, to registers or memory, could be looked at
+   later by checked code, and must not then appear undefined (or keep
+   the V bits of what was there before).  So every write is shadowed
+   by a write of "defined" to the same place.  Stores still go through
+   the usual STOREV helpers, so writes to unaddressable memory are
+   still reported.
+
+   This cuts the shadow work for such code down to one helper call
+   per store and one constant write per guest register written. */
+
+static IRAtom* definedAtomOfType ( MCEnv* mce, IRType ty )
+{
+   IRType  tyV = shadowTypeV(ty);
+   IRExpr* e   = definedOfType(tyV);
+   return isIRAtom(e) ? e : assignNew('V', mce, tyV, e);
+}
+
+static void do_uninstrumented_Store ( MCEnv* mce, IREndness end,
+                                      IRAtom* addr, UInt bias,
+                                      IRType ty, IRAtom* guard )
+{
+   do_shadow_Store( mce, end, addr, bias, NULL/*data*/,
+                    definedAtomOfType(mce, ty), guard );
+}
+
+static void do_uninstrumented_Dirty ( MCEnv* mce, IRDirty* d )
+{
+   Int       i, k, n, toDo, gSz, gOff;
+   IREndness end;
+
+#  if defined(VG_BIGENDIAN)
+   end = Iend_BE;
+#  elif defined(VG_LITTLEENDIAN)
+   end = Iend_LE;
+#  else
+#    error "Unknown endianness"
+#  endif
+
+   /* Guest state that the helper writes or modifies.  As in
+      do_shadow_Dirty, in chunks of at most 8 bytes. */
+   for (i = 0; i < d->nFxState; i++) {
+      if (d->fxState[i].fx == Ifx_Read)
+         continue;
+      for (k = 0; k < 1 + d->fxState[i].nRepeats; k++) {
+         gOff = d->fxState[i].offset + k * d->fxState[i].repeatLen;
+         gSz  = d->fxState[i].size;
+         if (isAlwaysDefd(mce, gOff, gSz))
+            continue;
+         while (gSz > 0) {
+            n = gSz <= 8 ? gSz : 8;
+            do_shadow_PUT( mce, gOff, NULL, definedOfType(szToITy(n)),
+                           d->guard );
+            gSz  -= n;
+            gOff += n;
+         }
+      }
+   }
+
+   /* Memory that the helper writes or modifies. */
+   if (d->mFx == Ifx_Write || d->mFx == Ifx_Modify) {
+      for (toDo = d->mSize; toDo >= 4; toDo -= 4)
+         do_uninstrumented_Store( mce, end, d->mAddr, d->mSize - toDo,
+                                  Ity_I32, d->guard );
+      for (; toDo >= 2; toDo -= 2)
+         do_uninstrumented_Store( mce, end, d->mAddr, d->mSize - toDo,
+                                  Ity_I16, d->guard );
+      if (toDo == 1)
+         do_uninstrumented_Store( mce, end, d->mAddr, d->mSize - toDo,
+                                  Ity_I8, d->guard );
+   }
+}
+
+/* How many shadow Puts MC_(instrument_uninstrumented) remembers, so
+   as not to repeat them. */
+#define N_UNINSTR_PUTS 32
+
+IRSB* MC_(instrument_uninstrumented) ( VgCallbackClosure* closure,
+                                       IRSB* sb_in,
+                                       const VexGuestLayout* layout,
+                                       const VexGuestExtents* vge,
+                                       const VexArchInfo* archinfo_host,
+                                       IRType gWordTy, IRType hWordTy )
+{
+   Int        i, j;
+   IRStmt*    st;
+   MCEnv      mce;
+   IRSB*      sb_out;
+   IRTypeEnv* tyenv = sb_in->tyenv;
+   struct { Int offset; Int size; } puts_done[N_UNINSTR_PUTS];
+   Int        n_puts_done = 0;
+
+   if (gWordTy != hWordTy) {
+      /* We don't currently support this case. */
+      VG_(tool_panic)("host/guest word size mismatch");
+   }
+
+   sb_out = deepCopyIRSBExceptStmts(sb_in);
+
+   /* Only shadow tmps are ever added, since original tmps never get
+      V bits here. */
+   VG_(memset)(&mce, 0, sizeof(mce));
+   mce.sb             = sb_out;
+   mce.trace          = False;
+   mce.layout         = layout;
+   mce.hWordTy        = hWordTy;
+   mce.uninstrumented = True;
+   mce.tmpMap = VG_(newXA)( VG_(malloc), "mc.MC_(instrument_uninstrumented).1",
+                            VG_(free), sizeof(TempMapEnt));
+   VG_(hintSizeXA) (mce.tmpMap, tyenv->types_used);
+   for (i = 0; i < tyenv->types_used; i++) {
+      TempMapEnt ent;
+      ent.kind    = Orig;
+      ent.shadowV = IRTemp_INVALID;
+      ent.shadowB = IRTemp_INVALID;
+      VG_(addToXA)( mce.tmpMap, &ent );
+   }
+
+   for (i = 0; i < sb_in->stmts_used; i++) {
+      st = sb_in->stmts[i];
+      tl_assert(isFlatIRStmt(st));
+
+      switch (st->tag) {
+
+         case Ist_Put: {
+            /* Nothing here ever makes a shadow register undefined, so
+               once a slice has been marked defined, later Puts to it
+               (typically the same registers, in the next iteration of
+               an unrolled loop) need not be shadowed again. */
+            Int    off = st->Ist.Put.offset;
+            IRType ty  = typeOfIRExpr(tyenv, st->Ist.Put.data);
+            Int    sz  = sizeofIRType(ty);
+            for (j = 0; j < n_puts_done; j++)
+               if (off >= puts_done[j].offset
+                   && off + sz <= puts_done[j].offset + puts_done[j].size)
+                  break;
+            if (j < n_puts_done)
+               break;
+            do_shadow_PUT( &mce, off, NULL, definedAtomOfType(&mce, ty),
+                           NULL );
+            if (n_puts_done < N_UNINSTR_PUTS) {
+               puts_done[n_puts_done].offset = off;
+               puts_done[n_puts_done].size   = sz;
+               n_puts_done++;
+            }
+            break;
+         }
+
+         case Ist_PutI: {
+            IRRegArray* descr = st->Ist.PutI.details->descr;
+            if (MC_(clo_mc_level) == 1
+                || isAlwaysDefd(&mce, descr->base,
+                                descr->nElems * sizeofIRType(descr->elemTy)))
+               break;
+            stmt( 'V', &mce,
+                  IRStmt_PutI( mkIRPutI(
+                     mkIRRegArray( descr->base + layout->total_sizeB,
+                                   shadowTypeV(descr->elemTy),
+                                   descr->nElems ),
+                     st->Ist.PutI.details->ix,
+                     st->Ist.PutI.details->bias,
+                     definedAtomOfType(&mce, descr->elemTy) )));
+            break;
+         }
+
+         case Ist_Store:
+            do_uninstrumented_Store(
+               &mce, st->Ist.Store.end, st->Ist.Store.addr, 0,
+               typeOfIRExpr(tyenv, st->Ist.Store.data), NULL );
+            break;
+
+         case Ist_StoreG: {
+            IRStoreG* sg = st->Ist.StoreG.details;
+            do_uninstrumented_Store( &mce, sg->end, sg->addr, 0,
+                                     typeOfIRExpr(tyenv, sg->data),
+                                     sg->guard );
+            break;
+         }
+
+         case Ist_CAS: {
+            /* Whether or not it succeeds, the location ends up holding
+               a value the trusted code chose to leave there. */
+            IRCAS* cas = st->Ist.CAS.details;
+            IRType ty  = typeOfIRExpr(tyenv, cas->dataLo);
+            do_uninstrumented_Store( &mce, cas->end, cas->addr, 0, ty, NULL );
+            if (cas->dataHi)
+               do_uninstrumented_Store( &mce, cas->end, cas->addr,
+                                        sizeofIRType(ty), ty, NULL );
+            break;
+         }
+
+         case Ist_LLSC:
+            if (st->Ist.LLSC.storedata)
+               do_uninstrumented_Store(
+                  &mce, st->Ist.LLSC.end, st->Ist.LLSC.addr, 0,
+                  typeOfIRExpr(tyenv, st->Ist.LLSC.storedata), NULL );
+            break;
+
+         case Ist_Dirty:
+            do_uninstrumented_Dirty( &mce, st->Ist.Dirty.details );
+            break;
+
+         case Ist_WrTmp:
+         case Ist_LoadG:
+         case Ist_Exit:
+         case Ist_IMark:
+         case Ist_NoOp:
+         case Ist_MBE:
+         case Ist_AbiHint:
+            break;
+
+         default:
+            VG_(printf)("\n");
+            ppIRStmt(st);
+            VG_(printf)("\n");
+            VG_(tool_panic)("memcheck: unhandled IRStmt");
+      }
+
+      stmt('C', &mce, st);
+   }
+
+   tl_assert( VG_(sizeXA)( mce.tmpMap ) == mce.sb->tyenv->types_used );
+   VG_(deleteXA)( mce.tmpMap );
+
+   tl_assert(mce.sb == sb_out);
+   return sb_out;
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Post-tree-build final tidying                        ---*/
 /*------------------------------------------------------------*/
@@ -6748,7 +7080,30 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
    register.  After optimisation of the instrumentation, you get a
    test for the definedness of the base register for each memory
    reference, which is kinda pointless.  MC_(final_tidy) therefore
-   looks for such repeated calls and removes all but the first. */
+   looks for such repeated calls and removes all but the first.
+
+   Since a superblock is a straight line with side exits, any earlier
+   check is made on every path to a later one, so if it passed, a
+   later check that it implies must pass too, and if it failed, the
+   later one would only report a duplicate error.  Hence:
+
+   * The guards are compared after looking through operations that
+     are nonzero exactly when their operand is: CmpNEZ, Left, widening
+     and comparison against zero.  That is, a guard is reduced to its
+     "nonzero root", the V bits whose definedness it tests.  So a test
+     of CmpNEZ64(Left64(t#)) is recognised as the same as an earlier
+     test of CmpNEZ64(t#), and vice versa, even though they differ
+     syntactically.  This is the case when a base register is used
+     directly as an address, and also with an offset added.  Roots
+     which are temporaries are looked through too, via their
+     definitions, since tree building leaves multiply-used temporaries
+     in place.
+
+   * The nonzero root only decides whether two guards are equivalent.
+     A check is removed only if an earlier one called the same helper,
+     since the helper determines the size of the value reported in the
+     error, and whether it carries an origin.
+*/
 
 
 /* With some testing on perf/bz2.c, on amd64 and x86, compiled with
@@ -6895,22 +7250,99 @@ Bool check_or_add ( Pairs* tidyingEnv, IRExpr* guard, void* entry )
    return False;
 }
 
+/* Is e a constant zero, of any integer type? */
+static Bool isZeroConst ( IRExpr* e )
+{
+   if (e->tag != Iex_Const)
+      return False;
+   switch (e->Iex.Const.con->tag) {
+      case Ico_U8:  return e->Iex.Const.con->Ico.U8  == 0;
+      case Ico_U16: return e->Iex.Const.con->Ico.U16 == 0;
+      case Ico_U32: return e->Iex.Const.con->Ico.U32 == 0;
+      case Ico_U64: return e->Iex.Const.con->Ico.U64 == 0;
+      default:      return False;
+   }
+}
+
+/* Return the nonzero root of e, as described above: the expression
+   r, found by looking through nonzero-preserving operations, such
+   that e is nonzero exactly when r is.  |defs| gives the definitions
+   of the temporaries which still have them, or NULL. */
+static IRExpr* nonzeroRoot ( IRExpr* e, IRExpr** defs, Int n_defs )
+{
+   while (True) {
+      switch (e->tag) {
+         case Iex_Unop:
+            switch (e->Iex.Unop.op) {
+               case Iop_CmpNEZ8:  case Iop_CmpNEZ16:
+               case Iop_CmpNEZ32: case Iop_CmpNEZ64:
+               case Iop_CmpwNEZ32: case Iop_CmpwNEZ64:
+               case Iop_Left8:  case Iop_Left16:
+               case Iop_Left32: case Iop_Left64:
+               case Iop_1Uto8:  case Iop_1Uto32: case Iop_1Uto64:
+               case Iop_8Uto16: case Iop_8Uto32: case Iop_8Uto64:
+               case Iop_16Uto32: case Iop_16Uto64: case Iop_32Uto64:
+               case Iop_8Sto16: case Iop_8Sto32: case Iop_8Sto64:
+               case Iop_16Sto32: case Iop_16Sto64: case Iop_32Sto64:
+                  e = e->Iex.Unop.arg;
+                  continue;
+               default:
+                  return e;
+            }
+         case Iex_Binop:
+            switch (e->Iex.Binop.op) {
+               case Iop_CmpNE8:  case Iop_CmpNE16:
+               case Iop_CmpNE32: case Iop_CmpNE64:
+               case Iop_ExpCmpNE32: case Iop_ExpCmpNE64:
+               case Iop_CasCmpNE32: case Iop_CasCmpNE64:
+                  if (isZeroConst(e->Iex.Binop.arg2)) {
+                     e = e->Iex.Binop.arg1;
+                     continue;
+                  }
+                  if (isZeroConst(e->Iex.Binop.arg1)) {
+                     e = e->Iex.Binop.arg2;
+                     continue;
+                  }
+                  return e;
+               default:
+                  return e;
+            }
+         case Iex_RdTmp: {
+            IRTemp  t = e->Iex.RdTmp.tmp;
+            IRExpr* d = t < n_defs ? defs[t] : NULL;
+            IRExpr* r = d ? nonzeroRoot(d, defs, n_defs) : NULL;
+            /* Only look through t if that gets somewhere, and to
+               something that sameIRValue can compare (that is, free
+               of Gets and Loads).  Otherwise t itself is the best
+               root. */
+            if (r && r != d && sameIRValue(r, r))
+               return r;
+            return e;
+         }
+         default:
+            return e;
+      }
+   }
+}
+
 static Bool is_helperc_value_checkN_fail ( const HChar* name )
 {
    /* This is expensive because it happens a lot.  We are checking to
-      see whether |name| is one of the following 8 strings:
+      see whether |name| is one of the following 10 strings:
 
          MC_(helperc_value_check8_fail_no_o)
          MC_(helperc_value_check4_fail_no_o)
          MC_(helperc_value_check0_fail_no_o)
          MC_(helperc_value_check1_fail_no_o)
+         MC_(helperc_value_checkN_fail_no_o)
          MC_(helperc_value_check8_fail_w_o)
          MC_(helperc_value_check0_fail_w_o)
          MC_(helperc_value_check1_fail_w_o)
          MC_(helperc_value_check4_fail_w_o)
+         MC_(helperc_value_checkN_fail_w_o)
 
       To speed it up, check the common prefix just once, rather than
-      all 8 times.
+      all 10 times.
    */
    const HChar* prefix = "MC_(helperc_value_check";
 
@@ -6932,30 +7364,64 @@ static Bool is_helperc_value_checkN_fail ( const HChar* name )
           || 0==VG_(strcmp)(name, "4_fail_no_o)")
           || 0==VG_(strcmp)(name, "0_fail_no_o)")
           || 0==VG_(strcmp)(name, "1_fail_no_o)")
+          || 0==VG_(strcmp)(name, "N_fail_no_o)")
           || 0==VG_(strcmp)(name, "8_fail_w_o)")
           || 0==VG_(strcmp)(name, "4_fail_w_o)")
           || 0==VG_(strcmp)(name, "0_fail_w_o)")
-          || 0==VG_(strcmp)(name, "1_fail_w_o)");
+          || 0==VG_(strcmp)(name, "1_fail_w_o)")
+          || 0==VG_(strcmp)(name, "N_fail_w_o)");
 }
 
+/* For --stats=yes: the number of value checks seen by
+   MC_(final_tidy), the number it removed, and how many of those it
+   would not have found by comparing the guards syntactically. */
+static ULong stats__tidy_checks         = 0;
+static ULong stats__tidy_checks_removed = 0;
+static ULong stats__tidy_checks_by_root = 0;
+
+/* The definitions of the temporaries, indexed by IRTemp.  Kept from
+   one superblock to the next, and only grown, so as to avoid an
+   allocation per superblock. */
+static IRExpr** tidy_defs      = NULL;
+static Int      tidy_defs_size = 0;
+
 IRSB* MC_(final_tidy) ( IRSB* sb_in )
 {
-   Int       i;
+   Int       i, n_defs;
    IRStmt*   st;
    IRDirty*  di;
    IRExpr*   guard;
+   IRExpr*   root;
+   IRExpr**  defs;
    IRCallee* cee;
    Bool      alreadyPresent;
-   Pairs     pairs;
+   Pairs     pairs, syntactic;
 
    pairs.pairsUsed = 0;
+   syntactic.pairsUsed = 0;
 
    pairs.pairs[N_TIDYING_PAIRS].entry = (void*)0x123;
    pairs.pairs[N_TIDYING_PAIRS].guard = (IRExpr*)0x456;
 
+   /* Find the definitions of the temporaries that survived tree
+      building. */
+   n_defs = sb_in->tyenv->types_used;
+   if (n_defs > tidy_defs_size) {
+      tidy_defs_size = n_defs < 256 ? 256 : 2 * n_defs;
+      tidy_defs = VG_(realloc)("mc.final_tidy.1", tidy_defs,
+                               tidy_defs_size * sizeof(IRExpr*));
+   }
+   defs = tidy_defs;
+   VG_(memset)(defs, 0, n_defs * sizeof(IRExpr*));
+   for (i = 0; i < sb_in->stmts_used; i++) {
+      st = sb_in->stmts[i];
+      if (st->tag == Ist_WrTmp)
+         defs[st->Ist.WrTmp.tmp] = st->Ist.WrTmp.data;
+   }
+
    /* Scan forwards through the statements.  Each time a call to one
       of the relevant helpers is seen, check if we have made a
-      previous call to the same helper using the same guard
+      previous call to the same helper with an equivalent guard
       expression, and if so, delete the call. */
    for (i = 0; i < sb_in->stmts_used; i++) {
       st = sb_in->stmts[i];
@@ -6969,15 +7435,25 @@ IRSB* MC_(final_tidy) ( IRSB* sb_in )
       cee = di->cee;
       if (!is_helperc_value_checkN_fail( cee->name )) 
          continue;
-       /* Ok, we have a call to helperc_value_check0/1/4/8_fail with
-          guard 'guard'.  Check if we have already seen a call to this
-          function with the same guard.  If so, delete it.  If not,
-          add it to the set of calls we do know about. */
-      alreadyPresent = check_or_add( &pairs, guard, cee->addr );
+       /* Ok, we have a call to helperc_value_check*_fail with guard
+          'guard'.  Check if we have already seen a call to this
+          function with an equivalent guard.  If so, delete it.  If
+          not, add it to the set of calls we do know about.  The
+          helper stays in the key: a check0 and a check4 on the same
+          root report different errors. */
+      stats__tidy_checks++;
+      root = nonzeroRoot( guard, defs, n_defs );
+      alreadyPresent = check_or_add( &pairs, root, cee->addr );
       if (alreadyPresent) {
          sb_in->stmts[i] = IRStmt_NoOp();
+         stats__tidy_checks_removed++;
          if (0) VG_(printf)("XX\n");
       }
+      /* Keep track of what comparing guards syntactically would have
+         achieved, for the stats. */
+      if (VG_(clo_stats) && !check_or_add( &syntactic, guard, cee->addr )
+          && alreadyPresent)
+         stats__tidy_checks_by_root++;
    }
 
    tl_assert(pairs.pairs[N_TIDYING_PAIRS].entry == (void*)0x123);
@@ -6986,6 +7462,15 @@ IRSB* MC_(final_tidy) ( IRSB* sb_in )
    return sb_in;
 }
 
+void MC_(print_tidy_stats) ( void )
+{
+   VG_(message)(Vg_DebugMsg,
+                " memcheck: value checks: %'llu generated, %'llu removed"
+                " as redundant (%'llu via nonzero roots)\n",
+                stats__tidy_checks, stats__tidy_checks_removed,
+                stats__tidy_checks_by_root);
+}
+
 #undef N_TIDYING_PAIRS
 
 
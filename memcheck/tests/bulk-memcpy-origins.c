@@ -0,0 +1,57 @@
+/* As bulk-memcpy, but with --track-origins=yes: check that undefined
+   bytes keep their origins when Memcheck does a large memcpy or
+   memmove itself, as they do when the replacement's loop does it.
+   The buffers are anonymous mappings, since only those are copied in
+   one go. */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "../memcheck.h"
+
+#define N 4096
+
+static char *src, *dst;
+
+static void test ( int len )
+{
+   int i;
+
+   fprintf(stderr, "len %d\n", len);
+
+   for (i = 0; i < N; i++)
+      src[i] = i;
+   VALGRIND_MAKE_MEM_UNDEFINED(src + 100, 1);
+
+   fprintf(stderr, "memcpy\n");
+   memset(dst, 0, N);
+   memcpy(dst, src, len);
+   if (dst[100] == 'x')
+      fprintf(stderr, "x\n");
+
+   /* Misaligned, so the origins can't be copied a word at a time. */
+   fprintf(stderr, "memcpy+1\n");
+   memset(dst, 0, N);
+   memcpy(dst + 1, src, len);
+   if (dst[101] == 'x')
+      fprintf(stderr, "x\n");
+
+   /* Overlapping, so the origins have to be copied backwards. */
+   fprintf(stderr, "memmove\n");
+   memmove(src + 8, src, len);
+   if (src[108] == 'x')
+      fprintf(stderr, "x\n");
+}
+
+int main ( void )
+{
+   src = mmap(NULL, N, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS,
+              -1, 0);
+   dst = mmap(NULL, N, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS,
+              -1, 0);
+   if (src == MAP_FAILED || dst == MAP_FAILED)
+      return 1;
+   test(200);
+   test(4000);
+   return 0;
+}
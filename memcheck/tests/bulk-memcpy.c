@@ -0,0 +1,68 @@
+/* Memcheck does large memcpys and memsets itself, rather than a word
+   at a time in the replacement functions.  Check that V bits are
+   copied exactly, and that errors are reported just as they are for
+   small copies, which still go through the replacements' loops. */
+
+#include <stdio.h>
+#include <string.h>
+#include "../memcheck.h"
+
+#define N 4096
+
+static char src[N], dst[N];
+
+/* Print the offsets and V bits of the undefined bytes in p[0..len). */
+static void show ( const char* what, const char* p, int len )
+{
+   unsigned char vbits[N];
+   int i;
+   VALGRIND_GET_VBITS(p, vbits, len);
+   printf("%-10s", what);
+   for (i = 0; i < len; i++)
+      if (vbits[i])
+         printf(" %d:%02x", i, vbits[i]);
+   printf("\n");
+}
+
+static void test ( int len )
+{
+   unsigned char vb = 0x0f;
+   int i, u;
+
+   printf("len %d\n", len);
+
+   for (i = 0; i < N; i++)
+      src[i] = i;
+   VALGRIND_MAKE_MEM_UNDEFINED(src + 100, 3);
+   VALGRIND_SET_VBITS(src + 150, &vb, 1);
+
+   memset(dst, 0, N);
+   memcpy(dst, src, len);
+   show("memcpy", dst, 160);
+
+   memset(dst, 0, N);
+   memcpy(dst + 1, src, len);
+   show("memcpy+1", dst, 160);
+
+   memmove(src + 8, src, len);
+   show("memmove", src, 160);
+
+   VALGRIND_MAKE_MEM_UNDEFINED(&u, sizeof(u));
+   memset(dst, u, len);
+   show("memset", dst, 8);
+   memset(dst, 'x', len);
+   show("memset", dst, 8);
+
+   /* The copy must not be done in one go; the replacement's loop has
+      to do it, and report the error. */
+   VALGRIND_MAKE_MEM_NOACCESS(dst + 151, 1);
+   memcpy(dst + 1, src, len);
+   VALGRIND_MAKE_MEM_DEFINED(dst + 151, 1);
+}
+
+int main ( void )
+{
+   test(200);
+   test(4000);
+   return 0;
+}
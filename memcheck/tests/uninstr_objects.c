@@ -0,0 +1,31 @@
+#include <stdio.h>
+#include "../memcheck.h"
+
+/* Test for --uninstrumented-objects.  The functions called here are
+   in uninstr_objects_so.so.  When that object is uninstrumented, the
+   uninitialised values it uses must not be reported, what it writes
+   must read as defined here, and its invalid write must still be
+   reported. */
+
+extern void uninstr_fill ( int* p, const int* junk, int n );
+extern void uninstr_overrun ( int* p, int n );
+
+/* The last element is made inaccessible, so the overrun is caught
+   without depending on the malloc redzones. */
+int uninstr_buf[11];
+int uninstr_junk[10];
+
+int main ( void )
+{
+   (void) VALGRIND_MAKE_MEM_NOACCESS(&uninstr_buf[10], sizeof(int));
+   (void) VALGRIND_MAKE_MEM_UNDEFINED(uninstr_junk, sizeof(uninstr_junk));
+
+   uninstr_fill(uninstr_buf, uninstr_junk, 10);
+   fprintf(stderr, "checking the results\n");
+   (void) VALGRIND_CHECK_MEM_IS_DEFINED(uninstr_buf, 10 * sizeof(int));
+
+   fprintf(stderr, "writing past the end\n");
+   uninstr_overrun(uninstr_buf, 10);
+
+   return 0;
+}
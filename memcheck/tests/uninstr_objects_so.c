@@ -0,0 +1,20 @@
+/* The library for uninstr_objects.  It makes decisions on
+   uninitialised values, and writes the results through a pointer. */
+
+void uninstr_fill ( int* p, const int* junk, int n )
+{
+   int i;
+   for (i = 0; i < n; i++) {
+      if (junk[i] > 0)
+         p[i] = 1;
+      else
+         p[i] = junk[i];
+   }
+}
+
+/* An off-by-one write, which must be reported even when this object
+   is not instrumented. */
+void uninstr_overrun ( int* p, int n )
+{
+   p[n] = 42;
+}
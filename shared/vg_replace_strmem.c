@@ -176,6 +176,19 @@ static inline void my_exit ( int x )
 #define VALGRIND_CHECK_VALUE_IS_DEFINED(__lvalue) 1
 #endif
 
+// A tool may define these to do a memcpy or memset itself, in one go,
+// rather than have every word of it go through the instrumented loops
+// below.  BULK_COPY copies len bytes from src to dst, which may overlap.
+// BULK_FILL sets the len bytes at dst to copies of the byte at cp.  Each
+// is nonzero if the tool did the work, and zero if the loop must do it
+// (and report any errors) as usual.
+#ifndef BULK_COPY
+#define BULK_COPY(dst, src, len) 0
+#endif
+#ifndef BULK_FILL
+#define BULK_FILL(dst, cp, len) ((void)(cp), 0)
+#endif
+
 
 /*---------------------- strrchr ----------------------*/
 
@@ -945,6 +958,9 @@ static inline void my_exit ( int x )
       if (do_ol_check && is_overlap(dst, src, len, len)) \
          RECORD_OVERLAP_ERROR("memcpy", dst, src, len); \
       \
+      if (BULK_COPY(dst, src, len)) \
+         return dst; \
+      \
       const Addr WS = sizeof(UWord); /* 8 or 4 */ \
       const Addr WM = WS - 1;        /* 7 or 3 */ \
       \
@@ -1197,6 +1213,10 @@ static inline void my_exit ( int x )
    void* VG_REPLACE_FUNCTION_EZZ(20210,soname,fnname) \
             (void *s, Int c, SizeT n) \
    { \
+      UChar c1 = (UChar)c; \
+      if (BULK_FILL(s, &c1, n)) \
+         return s; \
+      \
       if (sizeof(void*) == 8) { \
          Addr  a  = (Addr)s;   \
          ULong c8 = (c & 0xFF); \
@@ -1504,6 +1524,9 @@ static inline void my_exit ( int x )
       if (is_overlap(dst, src, len, len)) \
          RECORD_OVERLAP_ERROR("mempcpy", dst, src, len); \
       \
+      if (BULK_COPY(dst, src, len)) \
+         return (void*)( ((char*)dst) + len_saved ); \
+      \
       if ( dst > src ) { \
          register HChar *d = (char *)dst + len - 1; \
          register const HChar *s = (const char *)src + len - 1; \
@@ -1554,6 +1577,9 @@ static inline void my_exit ( int x )
       if (is_overlap(dst, src, len, len)) \
          RECORD_OVERLAP_ERROR("memcpy_chk", dst, src, len); \
       \
+      if (BULK_COPY(dst, src, len)) \
+         return dst; \
+      \
       if ( dst > src ) { \
          d = (HChar *)dst + len - 1; \
          s = (const HChar *)src + len - 1; \